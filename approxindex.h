@@ -0,0 +1,42 @@
+/**
+ *
+ * approxindex: rgbtree matching with a bounded error, for previews
+ *
+ */
+
+#ifndef _APPROXINDEX_H_
+#define _APPROXINDEX_H_
+
+#include <map>
+#include <string>
+#include "cs221util/RGBAPixel.h"
+#include "rgbtree.h"
+#include "nnindex.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * Puts rgbtree::findApproximateNeighbor behind the nnindex interface, so
+ * tile() can render with tiles at most (1+epsilon) times farther than the
+ * best ones, and optionally at most maxVisits nodes per pixel.
+ */
+class approxindex : public nnindex {
+
+public:
+
+    approxindex(const map<RGBAPixel, string> & photos, double epsilon, long maxVisits = 0)
+        : tree(photos), epsilon(epsilon), maxVisits(maxVisits) {}
+
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query) const
+    {
+        return tree.findApproximateNeighbor(query, epsilon, maxVisits);
+    }
+
+private:
+
+    rgbtree tree;
+    double epsilon;
+    long maxVisits;
+};
+
+#endif
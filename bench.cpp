@@ -0,0 +1,1147 @@
+// File:        bench.cpp
+// Description: micro-benchmarks for the search structures and image paths.
+//              build with `make bench`, run `./bench` for every section or
+//              `./bench <section> ...` for a subset.
+
+
+#include "rgbtree.h"
+#include "blocktree.h"
+#include "bfstree.h"
+#include "dynrgbtree.h"
+#include "colorspace.h"
+#include "labindex.h"
+#include "coneindex.h"
+#include "gridindex.h"
+#include "ivfindex.h"
+#include "de2000index.h"
+#include "grayindex.h"
+#include "vptree.h"
+#include "cs221util/PNG.h"
+#include "cs221util/RGBAPixel.h"
+#include "cs221util/HSLAPixel.h"
+#include "cs221util/RGB_HSL.h"
+#include "tileUtil.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cs221util;
+using namespace tiler;
+
+typedef chrono::steady_clock benchClock;
+
+static double secondsSince(benchClock::time_point start)
+{
+    return chrono::duration<double>(benchClock::now() - start).count();
+}
+
+static volatile size_t benchSink;
+
+// stores a value computed from a timed loop's results where the compiler
+// must assume it is read, so the loop can't be optimized away
+static void keep(size_t value)
+{
+    benchSink = value;
+}
+
+// n distinct, uniformly random library colors keyed to dummy file names
+static map<RGBAPixel, string> randomPhotos(int n, unsigned seed)
+{
+    mt19937 rng(seed);
+    map<RGBAPixel, string> photos;
+    while ((int) photos.size() < n) {
+        RGBAPixel p(rng() & 255, rng() & 255, rng() & 255);
+        photos[p] = "tile" + to_string(photos.size());
+    }
+    return photos;
+}
+
+static vector<RGBAPixel> randomQueries(int n, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<RGBAPixel> queries(n);
+    for (auto & q : queries) { q = RGBAPixel(rng() & 255, rng() & 255, rng() & 255); }
+    return queries;
+}
+
+// n descriptors of grid x grid blocks. each is a random base color plus
+// per-block noise of +-spread, which is how real thumbnails look: the blocks of
+// one image are correlated, not independent uniform coordinates.
+static vector<unsigned char> randomDescriptors(int n, int grid, int spread, mt19937 & rng)
+{
+    int dims = 3 * grid * grid;
+    vector<unsigned char> out((size_t) n * dims);
+    for (int i = 0; i < n; i++) {
+        int base[3] = { (int) (rng() & 255), (int) (rng() & 255), (int) (rng() & 255) };
+        for (int d = 0; d < dims; d++) {
+            int v = base[d % 3] + (int) (rng() % (2 * spread + 1)) - spread;
+            out[(size_t) i * dims + d] = v < 0 ? 0 : (v > 255 ? 255 : v);
+        }
+    }
+    return out;
+}
+
+////////////////////////////////////// SECTIONS
+
+/**
+ * blocks: query cost of sub-block descriptor matching (12-D, 27-D) against
+ * the 3-D average color path, per library size. Brute force is listed as the
+ * floor a tree has to beat.
+ */
+static void benchBlocks()
+{
+    const int QUERIES = 20000;
+    printf("%-8s %8s %12s %12s %12s\n", "index", "tiles", "ns/query", "nodes/query", "brute ns/q");
+
+    for (int n : {1000, 10000, 100000}) {
+        map<RGBAPixel, string> photos = randomPhotos(n, 1);
+        vector<RGBAPixel> queries = randomQueries(QUERIES, 2);
+        rgbtree tree(photos);
+
+        long sink = 0;
+        auto start = benchClock::now();
+        for (const auto & q : queries) { sink += tree.findNearestNeighbor(q).r; }
+        double rgbNs = secondsSince(start) * 1e9 / QUERIES;
+        printf("%-8s %8d %12.0f %12s %12s\n", "rgb 3-D", n, rgbNs, "-", "-");
+
+        for (int grid : {1, 2, 3}) {
+            int dims = 3 * grid * grid;
+            mt19937 rng(3);
+            vector<unsigned char> library = randomDescriptors(n, grid, 24, rng);
+            vector<unsigned char> probes = randomDescriptors(QUERIES, grid, 24, rng);
+            blocktree btree(library, dims);
+
+            long visited = 0;
+            start = benchClock::now();
+            for (int q = 0; q < QUERIES; q++) {
+                sink += btree.findNearestNeighbor(&probes[(size_t) q * dims], &visited);
+            }
+            double treeNs = secondsSince(start) * 1e9 / QUERIES;
+
+            // brute force on a sample of the queries
+            int sample = max(1, QUERIES * 1000 / n / 10);
+            start = benchClock::now();
+            for (int q = 0; q < sample; q++) {
+                const unsigned char * probe = &probes[(size_t) q * dims];
+                int best = INT_MAX, bestIndex = 0;
+                for (int i = 0; i < n; i++) {
+                    int dist = 0;
+                    for (int d = 0; d < dims; d++) {
+                        int diff = probe[d] - library[(size_t) i * dims + d];
+                        dist += diff * diff;
+                    }
+                    if (dist < best) { best = dist; bestIndex = i; }
+                }
+                sink += bestIndex;
+            }
+            double bruteNs = secondsSince(start) * 1e9 / sample;
+
+            char name[32];
+            snprintf(name, sizeof(name), "blk %d-D", dims);
+            printf("%-8s %8d %12.0f %12.1f %12.0f\n", name, n, treeNs,
+                   (double) visited / QUERIES, bruteNs);
+        }
+        keep((size_t) sink);
+    }
+}
+
+// the textbook conversion, with pow() and cbrt() per pixel, as the reference
+// the table-driven path is checked and timed against
+static colorspace::labPoint referenceLab(const RGBAPixel & p)
+{
+    double lin[3];
+    const unsigned char rgb[3] = { p.r, p.g, p.b };
+    for (int c = 0; c < 3; c++) {
+        double v = rgb[c] / 255.0;
+        lin[c] = v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+    }
+    double xyz[3] = {
+        (0.4124564 * lin[0] + 0.3575761 * lin[1] + 0.1804375 * lin[2]) / 0.95047,
+         0.2126729 * lin[0] + 0.7151522 * lin[1] + 0.0721750 * lin[2],
+        (0.0193339 * lin[0] + 0.1191920 * lin[1] + 0.9503041 * lin[2]) / 1.08883
+    };
+    double f[3];
+    for (int c = 0; c < 3; c++) {
+        f[c] = xyz[c] > 216.0 / 24389.0 ? cbrt(xyz[c]) : (24389.0 / 27.0 * xyz[c] + 16.0) / 116.0;
+    }
+    colorspace::labPoint out;
+    out.c[0] = 116.0 * f[1] - 16.0;
+    out.c[1] = 500.0 * (f[0] - f[1]);
+    out.c[2] = 200.0 * (f[1] - f[2]);
+    out.id = 0;
+    return out;
+}
+
+/**
+ * lab: whole-image sRGB -> Lab conversion throughput (table-driven batch vs
+ * the pow/cbrt reference) with the worst delta E between them, then query
+ * cost of labindex against rgbtree on the same library.
+ */
+static void benchLab()
+{
+    // a 100x150 target is 15000 pixels; time a few hundred of them
+    const int PIXELS = 15000, ROUNDS = 200;
+    vector<RGBAPixel> image = randomQueries(PIXELS, 4);
+    vector<colorspace::labPoint> lab(PIXELS);
+    double sink = 0;
+
+    auto start = benchClock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < PIXELS; i++) { lab[i] = referenceLab(image[i]); }
+        sink += lab[r % PIXELS].c[0];
+    }
+    double refSec = secondsSince(start);
+
+    start = benchClock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        colorspace::rgbToLab(image.data(), PIXELS, lab.data());
+        sink += lab[r % PIXELS].c[0];
+    }
+    double tableSec = secondsSince(start);
+
+    // exhaustive error check over every 8-bit color
+    double worst = 0;
+    for (int rgb = 0; rgb < (1 << 24); rgb += 7) {
+        RGBAPixel p(rgb >> 16, (rgb >> 8) & 255, rgb & 255);
+        colorspace::labPoint fast = colorspace::rgbToLab(p), ref = referenceLab(p);
+        double d = 0;
+        for (int c = 0; c < 3; c++) { d += (fast.c[c] - ref.c[c]) * (fast.c[c] - ref.c[c]); }
+        worst = max(worst, sqrt(d));
+    }
+
+    printf("%-10s %12s %12s\n", "convert", "Mpixel/s", "max dE");
+    printf("%-10s %12.1f %12s\n", "pow/cbrt", PIXELS * (double) ROUNDS / refSec / 1e6, "-");
+    printf("%-10s %12.1f %12.2g\n", "table", PIXELS * (double) ROUNDS / tableSec / 1e6, worst);
+
+    const int QUERIES = 20000;
+    printf("\n%-10s %8s %12s\n", "index", "tiles", "ns/query");
+    for (int n : {1000, 10000, 100000}) {
+        map<RGBAPixel, string> photos = randomPhotos(n, 1);
+        vector<RGBAPixel> queries = randomQueries(QUERIES, 2), results;
+        rgbtree rgb(photos);
+        labindex lab(photos);
+
+        start = benchClock::now();
+        rgb.findNearestNeighbors(queries, results);
+        double rgbNs = secondsSince(start) * 1e9 / QUERIES;
+        sink += results[0].r;
+
+        start = benchClock::now();
+        lab.findNearestNeighbors(queries, results);
+        double labNs = secondsSince(start) * 1e9 / QUERIES;
+        sink += results[0].r;
+
+        printf("%-10s %8d %12.0f\n", "rgb", n, rgbNs);
+        printf("%-10s %8d %12.0f\n", "lab", n, labNs);
+    }
+    keep((size_t) (long) sink);
+}
+
+static HSLAPixel toHSL(const RGBAPixel & p)
+{
+    rgbaColor rgb = { p.r, p.g, p.b, 255 };
+    hslaColor hsl = rgb2hsl(rgb);
+    (void) hsl2rgb;   // RGB_HSL.h defines both helpers static
+    return HSLAPixel(hsl.h, hsl.s, hsl.l);
+}
+
+/**
+ * hsl: HSL cone matching. Conversion throughput of rgb2hsl plus the trig that
+ * HSLAPixel::dist does per comparison against the batch cone conversion, the
+ * worst coordinate error between them, and query cost of coneindex against a
+ * scan with HSLAPixel::dist (whose answers it must reproduce).
+ */
+static void benchHSL()
+{
+    const double RAD = 3.14159265 / 180.;
+    const int PIXELS = 15000, ROUNDS = 200;
+    vector<RGBAPixel> image = randomQueries(PIXELS, 4);
+    vector<colorspace::conePoint> cone(PIXELS);
+    double sink = 0;
+
+    auto start = benchClock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < PIXELS; i++) {
+            HSLAPixel h = toHSL(image[i]);
+            cone[i].c[0] = sin(h.h * RAD) * h.s * h.l;
+            cone[i].c[1] = cos(h.h * RAD) * h.s * h.l;
+            cone[i].c[2] = h.l;
+        }
+        sink += cone[r % PIXELS].c[0];
+    }
+    double refSec = secondsSince(start);
+
+    start = benchClock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        colorspace::rgbToCone(image.data(), PIXELS, cone.data());
+        sink += cone[r % PIXELS].c[0];
+    }
+    double batchSec = secondsSince(start);
+
+    double worst = 0;
+    for (int rgb = 0; rgb < (1 << 24); rgb += 7) {
+        RGBAPixel p(rgb >> 16, (rgb >> 8) & 255, rgb & 255);
+        HSLAPixel h = toHSL(p);
+        colorspace::conePoint fast = colorspace::rgbToCone(p);
+        double ref[3] = { sin(h.h * RAD) * h.s * h.l, cos(h.h * RAD) * h.s * h.l, h.l };
+        for (int c = 0; c < 3; c++) { worst = max(worst, fabs(fast.c[c] - ref[c])); }
+    }
+
+    printf("%-10s %12s %12s\n", "convert", "Mpixel/s", "max error");
+    printf("%-10s %12.1f %12s\n", "rgb2hsl", PIXELS * (double) ROUNDS / refSec / 1e6, "-");
+    printf("%-10s %12.1f %12.2g\n", "batch", PIXELS * (double) ROUNDS / batchSec / 1e6, worst);
+
+    const int QUERIES = 20000;
+    printf("\n%-10s %8s %12s %12s\n", "index", "tiles", "ns/query", "mismatches");
+    for (int n : {1000, 10000}) {
+        map<RGBAPixel, string> photos = randomPhotos(n, 1);
+        vector<RGBAPixel> queries = randomQueries(QUERIES, 2), results;
+        coneindex index(photos);
+
+        start = benchClock::now();
+        index.findNearestNeighbors(queries, results);
+        double coneNs = secondsSince(start) * 1e9 / QUERIES;
+
+        // the scan on a sample, counting answers that are farther than its own
+        vector<HSLAPixel> library;
+        for (auto const & x : photos) { library.push_back(toHSL(x.first)); }
+        int sample = QUERIES / 20, mismatches = 0;
+        start = benchClock::now();
+        for (int q = 0; q < sample; q++) {
+            HSLAPixel query = toHSL(queries[q]);
+            double best = 1e9;
+            for (const auto & h : library) { best = min(best, query.dist(h)); }
+            if (query.dist(toHSL(results[q])) > best + 1e-6) { mismatches++; }
+        }
+        double scanNs = secondsSince(start) * 1e9 / sample;
+
+        printf("%-10s %8d %12.0f %12s\n", "dist scan", n, scanNs, "-");
+        printf("%-10s %8d %12.0f %12d\n", "coneindex", n, coneNs, mismatches);
+        sink += results[0].r;
+    }
+    keep((size_t) (long) sink);
+}
+
+/**
+ * build: rgbtree construction time per library size, serial against the
+ * parallel build, which must produce the same array.
+ */
+static void benchBuild()
+{
+    unsigned threads = parallel::defaultThreads();
+    printf("%-8s %8s %12s %12s %10s\n", "tiles", "threads", "serial ms", "parallel ms", "identical");
+
+    for (int n : {10000, 100000, 1000000}) {
+        map<RGBAPixel, string> photos = randomPhotos(n, 1);
+
+        auto start = benchClock::now();
+        rgbtree serial(photos, 1);
+        double serialMs = secondsSince(start) * 1e3;
+
+        start = benchClock::now();
+        rgbtree parallel(photos, threads);
+        double parallelMs = secondsSince(start) * 1e3;
+
+        printf("%-8d %8u %12.1f %12.1f %10s\n", n, threads, serialMs, parallelMs,
+               serial.tree == parallel.tree ? "yes" : "NO");
+    }
+}
+
+/**
+ * order: RGBAPixel::operator< as the library map and sorting use it -- time
+ * to fill a map with random colors and to sort a million pixels, and what
+ * each got wrong: distinct colors the map merged away, and neighbors the
+ * sort left out of order (both 0 for a strict weak ordering).
+ */
+static void benchOrder()
+{
+    printf("%-10s %10s %10s %12s\n", "operation", "pixels", "ms", "wrong");
+
+    const int KEYS = 200000;
+    vector<RGBAPixel> colors = randomQueries(KEYS, 81);
+    auto start = benchClock::now();
+    map<RGBAPixel, string> photos;
+    for (const RGBAPixel & c : colors) { photos[c] = "tile"; }
+    double mapMs = secondsSince(start) * 1e3;
+    vector<bool> seen(1 << 24, false);
+    int distinct = 0;
+    for (const RGBAPixel & c : colors) {
+        int code = c.r << 16 | c.g << 8 | c.b;
+        if (!seen[code]) { seen[code] = true; distinct++; }
+    }
+    printf("%-10s %10d %10.1f %12d\n", "map", KEYS, mapMs, distinct - (int) photos.size());
+
+    const int PIXELS = 1000000;
+    vector<RGBAPixel> pixels = randomQueries(PIXELS, 82);
+    start = benchClock::now();
+    sort(pixels.begin(), pixels.end());
+    double sortMs = secondsSince(start) * 1e3;
+    int unsorted = 0;
+    for (int i = 1; i < PIXELS; i++) {
+        const RGBAPixel & p = pixels[i - 1], & q = pixels[i];
+        unsorted += (p.r << 16 | p.g << 8 | p.b) > (q.r << 16 | q.g << 8 | q.b);
+    }
+    printf("%-10s %10d %10.1f %12d\n", "sort", PIXELS, sortMs, unsorted);
+}
+
+/**
+ * select: serial rgbtree build time on libraries in the orders that used to
+ * make quickSelect quadratic (sorted, as buildMap's map hands them over, and
+ * reversed), on a duplicate-heavy flat-color library, and on random order --
+ * with introselect medians and with the 256-bin histogram medians.
+ */
+static void benchSelect()
+{
+    printf("%-10s %8s %14s %14s\n", "order", "tiles", "quickselect ms", "histogram ms");
+
+    for (int n : {10000, 100000, 1000000}) {
+        map<RGBAPixel, string> photos = randomPhotos(n, 1);
+        vector<RGBAPixel> sorted;
+        for (auto const & x : photos) { sorted.push_back(x.first); }
+        vector<RGBAPixel> reversed(sorted.rbegin(), sorted.rend());
+        vector<RGBAPixel> shuffled = sorted;
+        shuffle(shuffled.begin(), shuffled.end(), mt19937(5));
+
+        // 64 flat colors repeated: almost every key ties on every channel
+        vector<RGBAPixel> flat(n);
+        mt19937 rng(6);
+        for (auto & p : flat) { p = RGBAPixel((rng() & 3) * 85, (rng() & 3) * 85, (rng() & 3) * 85); }
+
+        const pair<const char *, const vector<RGBAPixel> *> orders[] = {
+            { "sorted", &sorted }, { "reversed", &reversed }, { "flat", &flat }, { "random", &shuffled }
+        };
+        for (const auto & order : orders) {
+            auto start = benchClock::now();
+            rgbtree quick(*order.second, 1, rgbtree::QUICKSELECT);
+            double quickMs = secondsSince(start) * 1e3;
+
+            start = benchClock::now();
+            rgbtree counted(*order.second, 1, rgbtree::HISTOGRAM);
+            double histogramMs = secondsSince(start) * 1e3;
+
+            printf("%-10s %8d %14.1f %14.1f\n", order.first, n, quickMs, histogramMs);
+        }
+    }
+}
+
+/**
+ * layout: queries/sec of rgbtree's midpoint layout against bfstree's
+ * breadth-first layout, at library sizes whose nodes fit in L1, L2, L3 and
+ * only in DRAM. Every bfstree answer is checked to be as close as rgbtree's.
+ */
+static void benchLayout()
+{
+    const int QUERIES = 200000;
+    printf("%-8s %10s %14s %14s %8s\n", "tiles", "node KB", "midpoint q/s", "bfs q/s", "agree");
+
+    for (int n : {2000, 32000, 500000, 8000000}) {
+        vector<RGBAPixel> keys = randomQueries(n, 7);
+        vector<RGBAPixel> queries = randomQueries(QUERIES, 8);
+        rgbtree midpoint(keys);
+        bfstree bfs(midpoint);
+
+        vector<RGBAPixel> a(QUERIES), b(QUERIES);
+        auto start = benchClock::now();
+        for (int q = 0; q < QUERIES; q++) { a[q] = midpoint.findNearestNeighbor(queries[q]); }
+        double midpointSec = secondsSince(start);
+
+        start = benchClock::now();
+        for (int q = 0; q < QUERIES; q++) { b[q] = bfs.findNearestNeighbor(queries[q]); }
+        double bfsSec = secondsSince(start);
+
+        int agree = 0;
+        for (int q = 0; q < QUERIES; q++) {
+            agree += midpoint.distance3D(queries[q], a[q]) == midpoint.distance3D(queries[q], b[q]);
+        }
+        printf("%-8d %10.0f %14.0f %14.0f %7.1f%%\n", n, n * sizeof(RGBAPixel) / 1024.0,
+               QUERIES / midpointSec, QUERIES / bfsSec, 100.0 * agree / QUERIES);
+    }
+}
+
+/**
+ * leaves: rgbtree query cost with leaf buckets of 8, 16 and 32 keys against
+ * the fully split tree, per library size.
+ */
+static void benchLeaves()
+{
+    const int QUERIES = 200000;
+    printf("%-8s %8s %12s %10s\n", "tiles", "leafSize", "ns/query", "speedup");
+
+    for (int n : {1000, 10000, 100000, 1000000}) {
+        vector<RGBAPixel> keys = randomQueries(n, 7);
+        vector<RGBAPixel> queries = randomQueries(QUERIES, 8);
+        double baseNs = 0;
+        long sink = 0;
+
+        for (int leafSize : {1, 8, 16, 32}) {
+            rgbtree tree(keys, 0, rgbtree::QUICKSELECT, leafSize);
+            auto start = benchClock::now();
+            for (const auto & q : queries) { sink += tree.findNearestNeighbor(q).r; }
+            double ns = secondsSince(start) * 1e9 / QUERIES;
+            if (leafSize == 1) { baseNs = ns; }
+            printf("%-8d %8d %12.0f %9.2fx\n", n, leafSize, ns, baseNs / ns);
+        }
+        keep((size_t) sink);
+    }
+}
+
+/**
+ * dynamic: dynrgbtree inserts and deletes per second, and its query cost
+ * next to a static rgbtree over the same live keys -- after inserting
+ * everything one at a time, and again after deleting half of it.
+ */
+static void benchDynamic()
+{
+    const int QUERIES = 100000;
+    printf("%-8s %12s %12s %12s %12s %12s %12s\n", "tiles", "inserts/s", "static ns/q",
+           "dyn ns/q", "removes/s", "static ns/q", "dyn ns/q");
+
+    for (int n : {10000, 100000, 1000000}) {
+        vector<RGBAPixel> keys = randomQueries(n, 9);
+        vector<RGBAPixel> queries = randomQueries(QUERIES, 10);
+        long sink = 0;
+
+        dynrgbtree dynamic;
+        auto start = benchClock::now();
+        for (const auto & k : keys) { dynamic.insert(k); }
+        double insertRate = n / secondsSince(start);
+
+        auto queryNs = [&](const nnindex & index) {
+            auto begin = benchClock::now();
+            for (const auto & q : queries) { sink += index.findNearestNeighbor(q).r; }
+            return secondsSince(begin) * 1e9 / QUERIES;
+        };
+        double staticFull = queryNs(rgbtree(keys));
+        double dynamicFull = queryNs(dynamic);
+
+        // retire every other key
+        start = benchClock::now();
+        for (int i = 0; i < n; i += 2) { dynamic.remove(keys[i]); }
+        double removeRate = (n / 2) / secondsSince(start);
+
+        vector<RGBAPixel> kept;
+        for (int i = 1; i < n; i += 2) { kept.push_back(keys[i]); }
+        double staticHalf = queryNs(rgbtree(kept));
+        double dynamicHalf = queryNs(dynamic);
+
+        printf("%-8d %12.0f %12.0f %12.0f %12.0f %12.0f %12.0f\n", n, insertRate, staticFull,
+               dynamicFull, removeRate, staticHalf, dynamicHalf);
+        keep((size_t) sink);
+    }
+
+    // random inserts, removes and queries against brute force over the live
+    // keys: an answer is wrong if it isn't live or isn't at the least distance
+    minstd_rand rng(12);
+    dynrgbtree dynamic;
+    vector<RGBAPixel> live;
+    int checked = 0, wrong = 0;
+    auto distance3D = [](const RGBAPixel & a, const RGBAPixel & b) {
+        return (a.r - b.r) * (a.r - b.r) + (a.g - b.g) * (a.g - b.g) + (a.b - b.b) * (a.b - b.b);
+    };
+    for (int step = 0; step < 20000; step++) {
+        int action = rng() % 3;
+        if (action == 0 && !live.empty()) {
+            size_t i = rng() % live.size();
+            dynamic.remove(live[i]);
+            live[i] = live.back();
+            live.pop_back();
+        }
+        else if (action == 1) {
+            // a coarse palette, so duplicates and equal distances are common,
+            // without black: RGBAPixel() mustn't pass for a live key
+            RGBAPixel key(32 + rng() % 7 * 32, 32 + rng() % 7 * 32, 32 + rng() % 7 * 32);
+            dynamic.insert(key);
+            live.push_back(key);
+        }
+        else if (!live.empty()) {
+            RGBAPixel q(rng() % 256, rng() % 256, rng() % 256);
+            RGBAPixel found = dynamic.findNearestNeighbor(q);
+            int best = INT_MAX;
+            bool present = false;
+            for (const RGBAPixel & k : live) {
+                best = min(best, distance3D(q, k));
+                present = present || k.key() == found.key();
+            }
+            checked++;
+            wrong += !present || distance3D(q, found) != best;
+        }
+    }
+    printf("random insert/remove/query: %d queries, %d wrong\n", checked, wrong);
+}
+
+/**
+ * approx: rgbtree's approximate search per epsilon and visit budget --
+ * query cost, nodes visited, and error against the exact answer: the share
+ * of queries answered exactly, the mean extra distance (in RGB units) and the
+ * worst distance ratio, which epsilon alone bounds by 1+epsilon.
+ */
+static void benchApprox()
+{
+    const int QUERIES = 100000;
+    printf("%-8s %8s %8s %10s %12s %8s %10s %10s\n", "tiles", "epsilon", "budget", "ns/query",
+           "nodes/query", "exact", "mean +d", "max ratio");
+
+    for (int n : {10000, 1000000}) {
+        vector<RGBAPixel> keys = randomQueries(n, 11);
+        vector<RGBAPixel> queries = randomQueries(QUERIES, 12);
+        rgbtree tree(keys);
+
+        vector<int> exact(QUERIES);
+        for (int q = 0; q < QUERIES; q++) {
+            exact[q] = tree.distance3D(queries[q], tree.findNearestNeighbor(queries[q]));
+        }
+
+        for (long budget : {0L, 64L, 24L}) {
+            for (double epsilon : {0.0, 0.1, 0.25, 0.5, 1.0}) {
+                vector<RGBAPixel> found(QUERIES);
+                long visited = 0;
+                auto start = benchClock::now();
+                for (int q = 0; q < QUERIES; q++) {
+                    found[q] = tree.findApproximateNeighbor(queries[q], epsilon, budget, &visited);
+                }
+                double ns = secondsSince(start) * 1e9 / QUERIES;
+
+                int hits = 0;
+                double extra = 0, worst = 1;
+                for (int q = 0; q < QUERIES; q++) {
+                    int d = tree.distance3D(queries[q], found[q]);
+                    hits += d == exact[q];
+                    extra += sqrt((double) d) - sqrt((double) exact[q]);
+                    if (exact[q] > 0) { worst = max(worst, sqrt((double) d / exact[q])); }
+                }
+                printf("%-8d %8.2f %8ld %10.0f %12.1f %7.1f%% %10.3f %10.3f\n", n, epsilon, budget, ns,
+                       (double) visited / QUERIES, 100.0 * hits / QUERIES, extra / QUERIES, worst);
+            }
+        }
+    }
+}
+
+//////////////////////////////////////
+
+struct benchSection {
+    const char * name;
+    void (*run)();
+};
+
+/**
+ * radius: rgbtree's range query per radius -- keys in range, time for the
+ * full result, for stopping at the first four and for sampling four, against
+ * a brute-force scan of every key.
+ */
+static void benchRadius()
+{
+    const int QUERIES = 20000;
+    printf("%-8s %8s %12s %10s %12s %12s %10s\n", "tiles", "radius", "keys/query", "ns/query",
+           "first 4 ns", "sample 4 ns", "scan ns");
+
+    for (int n : {10000, 1000000}) {
+        vector<RGBAPixel> keys = randomQueries(n, 21);
+        vector<RGBAPixel> queries = randomQueries(QUERIES, 22);
+        rgbtree tree(keys);
+
+        for (int radius : {4, 8, 16, 32}) {
+            int r2 = radius * radius;
+            vector<RGBAPixel> out;
+            size_t found = 0;
+            auto start = benchClock::now();
+            for (const RGBAPixel & q : queries) { found += tree.findInRadius(q, r2, out); }
+            double ns = secondsSince(start) * 1e9 / QUERIES;
+
+            start = benchClock::now();
+            for (const RGBAPixel & q : queries) { tree.findInRadius(q, r2, out, 4); }
+            double firstNs = secondsSince(start) * 1e9 / QUERIES;
+
+            minstd_rand rng(23);
+            start = benchClock::now();
+            for (const RGBAPixel & q : queries) { tree.findInRadius(q, r2, out, 4, &rng); }
+            double sampleNs = secondsSince(start) * 1e9 / QUERIES;
+
+            // the scan is slow on the large library, so time a slice of the queries
+            int scanQueries = n > 100000 ? QUERIES / 100 : QUERIES;
+            size_t scanned = 0;
+            start = benchClock::now();
+            for (int q = 0; q < scanQueries; q++) {
+                for (const RGBAPixel & k : keys) { scanned += tree.distance3D(queries[q], k) <= r2; }
+            }
+            double scanNs = secondsSince(start) * 1e9 / scanQueries;
+            if (scanned == 42) { printf(" "); }
+
+            printf("%-8d %8d %12.1f %10.0f %12.0f %12.0f %10.0f\n", n, radius, (double) found / QUERIES,
+                   ns, firstNs, sampleNs, scanNs);
+        }
+    }
+}
+
+/**
+ * warm: rgbtree's batch search, which warm-starts each query from the answer
+ * to its Z-order predecessor, against cold per-query searches -- nodes
+ * visited and time, for random colors and for every pixel of a real target
+ * (targets/geoSM.png, 960x960), where neighboring colors repeat and cluster,
+ * and for its distinct colors alone.
+ */
+static void benchWarm()
+{
+    PNG target;
+    if (!target.readFromFile("targets/geoSM.png")) { return; }
+    vector<RGBAPixel> pixels;
+    for (unsigned x = 0; x < target.width(); x++) {
+        for (unsigned y = 0; y < target.height(); y++) {
+            const RGBAPixel * p = target.getPixel(x, y);
+            pixels.push_back(RGBAPixel(p->r, p->g, p->b));
+        }
+    }
+
+    // the target's colors once each, so repeats can't shortcut the search
+    vector<RGBAPixel> distinct;
+    vector<bool> seen(1 << 24, false);
+    for (const RGBAPixel & p : pixels) {
+        int code = p.r << 16 | p.g << 8 | p.b;
+        if (!seen[code]) { seen[code] = true; distinct.push_back(p); }
+    }
+
+    printf("%-8s %-8s %10s %12s %12s %10s %10s\n", "tiles", "queries", "count", "cold nodes",
+           "warm nodes", "cold ns", "warm ns");
+    for (int n : {10000, 1000000}) {
+        rgbtree tree(randomQueries(n, 31));
+        vector<pair<const char *, vector<RGBAPixel> > > sets = {
+            { "random", randomQueries(pixels.size(), 32) }, { "target", pixels }, { "distinct", distinct }
+        };
+        for (const auto & set : sets) {
+            const vector<RGBAPixel> & queries = set.second;
+            long cold = 0, warm = 0;
+            vector<RGBAPixel> coldResults(queries.size()), warmResults;
+
+            auto start = benchClock::now();
+            for (size_t q = 0; q < queries.size(); q++) {
+                coldResults[q] = tree.findApproximateNeighbor(queries[q], 0, 0, &cold);
+            }
+            double coldNs = secondsSince(start) * 1e9 / queries.size();
+
+            start = benchClock::now();
+            tree.findNearestNeighbors(queries, warmResults, &warm);
+            double warmNs = secondsSince(start) * 1e9 / queries.size();
+
+            for (size_t q = 0; q < queries.size(); q++) {
+                if (tree.distance3D(queries[q], coldResults[q]) != tree.distance3D(queries[q], warmResults[q])) {
+                    printf("MISMATCH at query %zu\n", q);
+                    break;
+                }
+            }
+            printf("%-8d %-8s %10zu %12.1f %12.1f %10.0f %10.0f\n", n, set.first, queries.size(),
+                   (double) cold / queries.size(), (double) warm / queries.size(), coldNs, warmNs);
+        }
+    }
+}
+
+/**
+ * packets: rgbtree's packet traversal against one query at a time -- nodes
+ * fetched per query (a packet fetches a node once for all its lanes) and
+ * time, for random colors and for the distinct colors of a real target,
+ * with single-key and bucketed leaves.
+ */
+static void benchPackets()
+{
+    PNG target;
+    if (!target.readFromFile("targets/geoSM.png")) { return; }
+    vector<RGBAPixel> distinct;
+    vector<bool> seen(1 << 24, false);
+    for (unsigned y = 0; y < target.height(); y++) {
+        for (unsigned x = 0; x < target.width(); x++) {
+            const RGBAPixel * p = target.getPixel(x, y);
+            int code = p->r << 16 | p->g << 8 | p->b;
+            if (!seen[code]) { seen[code] = true; distinct.push_back(RGBAPixel(p->r, p->g, p->b)); }
+        }
+    }
+
+    printf("%-8s %6s %-8s %12s %12s %10s %10s\n", "tiles", "leaf", "queries", "single nodes",
+           "packet nodes", "single ns", "packet ns");
+    for (int n : {10000, 1000000}) {
+        vector<RGBAPixel> keys = randomQueries(n, 41);
+        for (int leaf : {1, 8}) {
+            rgbtree tree(keys, 0, rgbtree::QUICKSELECT, leaf);
+            vector<pair<const char *, vector<RGBAPixel> > > sets = {
+                { "random", randomQueries(200000, 42) }, { "distinct", distinct }
+            };
+            for (const auto & set : sets) {
+                const vector<RGBAPixel> & queries = set.second;
+                long single = 0, packed = 0;
+                vector<RGBAPixel> singleResults(queries.size()), packetResults;
+
+                auto start = benchClock::now();
+                for (size_t q = 0; q < queries.size(); q++) {
+                    singleResults[q] = tree.findApproximateNeighbor(queries[q], 0, 0, &single);
+                }
+                double singleNs = secondsSince(start) * 1e9 / queries.size();
+
+                start = benchClock::now();
+                tree.findNearestNeighborPackets(queries, packetResults, &packed);
+                double packetNs = secondsSince(start) * 1e9 / queries.size();
+
+                for (size_t q = 0; q < queries.size(); q++) {
+                    if (tree.distance3D(queries[q], singleResults[q]) != tree.distance3D(queries[q], packetResults[q])) {
+                        printf("MISMATCH at query %zu\n", q);
+                        break;
+                    }
+                }
+                printf("%-8d %6d %-8s %12.1f %12.1f %10.0f %10.0f\n", n, leaf, set.first,
+                       (double) single / queries.size(), (double) packed / queries.size(), singleNs, packetNs);
+            }
+        }
+    }
+}
+
+// n colors drawn around a few random centers (normal, sigma in RGB units);
+// the same centerSeed gives the same centers
+static vector<RGBAPixel> clusteredColors(int n, int clusters, double sigma, unsigned centerSeed,
+                                         unsigned seed)
+{
+    mt19937 rng(centerSeed);
+    uniform_int_distribution<int> channel(0, 255);
+    normal_distribution<double> spread(0, sigma);
+    vector<RGBAPixel> centers(clusters);
+    for (RGBAPixel & c : centers) { c = RGBAPixel(channel(rng), channel(rng), channel(rng)); }
+    rng.seed(seed);
+
+    auto clamp255 = [](double v) { return (int) max(0.0, min(255.0, round(v))); };
+    vector<RGBAPixel> colors(n);
+    for (RGBAPixel & p : colors) {
+        const RGBAPixel & c = centers[rng() % clusters];
+        p = RGBAPixel(clamp255(c.r + spread(rng)), clamp255(c.g + spread(rng)), clamp255(c.b + spread(rng)));
+    }
+    return colors;
+}
+
+/**
+ * grid: gridindex against rgbtree on uniform and clustered libraries -- build
+ * time, and query time for uniform queries (which land far from clustered
+ * libraries' colors) and for queries drawn like the library.
+ */
+static void benchGrid()
+{
+    const int QUERIES = 20000;
+    printf("%-8s %-10s %6s %10s %10s %-8s %10s %10s\n", "tiles", "library", "side", "tree ms",
+           "grid ms", "queries", "tree ns", "grid ns");
+
+    for (int n : {10000, 1000000}) {
+        // each library with queries drawn the same way
+        struct { const char * name; vector<RGBAPixel> keys, alike; } libraries[] = {
+            { "uniform", randomQueries(n, 51), randomQueries(QUERIES, 55) },
+            { "clusters", clusteredColors(n, 16, 12.0, 52, 1), clusteredColors(QUERIES, 16, 12.0, 52, 2) },
+            { "tight", clusteredColors(n, 4, 3.0, 53, 1), clusteredColors(QUERIES, 4, 3.0, 53, 2) }
+        };
+        for (const auto & library : libraries) {
+            auto start = benchClock::now();
+            rgbtree tree(library.keys);
+            double treeMs = secondsSince(start) * 1e3;
+            start = benchClock::now();
+            gridindex grid(library.keys);
+            double gridMs = secondsSince(start) * 1e3;
+
+            vector<pair<const char *, vector<RGBAPixel> > > querySets = {
+                { "uniform", randomQueries(QUERIES, 54) }, { "alike", library.alike }
+            };
+            for (const auto & set : querySets) {
+                const vector<RGBAPixel> & queries = set.second;
+                vector<RGBAPixel> treeResults(queries.size()), gridResults(queries.size());
+                start = benchClock::now();
+                for (size_t q = 0; q < queries.size(); q++) { treeResults[q] = tree.findNearestNeighbor(queries[q]); }
+                double treeNs = secondsSince(start) * 1e9 / queries.size();
+                start = benchClock::now();
+                for (size_t q = 0; q < queries.size(); q++) { gridResults[q] = grid.findNearestNeighbor(queries[q]); }
+                double gridNs = secondsSince(start) * 1e9 / queries.size();
+
+                for (size_t q = 0; q < queries.size(); q++) {
+                    if (tree.distance3D(queries[q], treeResults[q]) != tree.distance3D(queries[q], gridResults[q])) {
+                        printf("MISMATCH at query %zu\n", q);
+                        break;
+                    }
+                }
+                printf("%-8d %-10s %6d %10.1f %10.1f %-8s %10.0f %10.0f\n", n, library.name,
+                       grid.cellsPerAxis(), treeMs, gridMs, set.first, treeNs, gridNs);
+            }
+        }
+    }
+}
+
+/**
+ * ivf: ivfindex on million-tile libraries -- build time, then query time,
+ * keys scanned and recall (answers as close as rgbtree's) for 1, 2, 4 and 8
+ * probes and the exact mode, with rgbtree's query time for reference.
+ */
+static void benchIVF()
+{
+    const int N = 1000000;
+    const int QUERIES = 20000;
+    printf("%-10s %8s %10s %-7s %10s %10s %8s\n", "library", "clusters", "build ms", "probes",
+           "ns/query", "scanned", "recall%");
+
+    struct { const char * name; vector<RGBAPixel> keys; } libraries[] = {
+        { "uniform", randomQueries(N, 61) },
+        { "clusters", clusteredColors(N, 16, 12.0, 62, 1) }
+    };
+    vector<RGBAPixel> queries = randomQueries(QUERIES, 63);
+    for (const auto & library : libraries) {
+        rgbtree tree(library.keys);
+        vector<RGBAPixel> expected(queries.size());
+        auto start = benchClock::now();
+        for (size_t q = 0; q < queries.size(); q++) { expected[q] = tree.findNearestNeighbor(queries[q]); }
+        printf("%-10s %8s %10s %-7s %10.0f %10s %8s\n", library.name, "-", "-", "tree",
+               secondsSince(start) * 1e9 / queries.size(), "-", "100.0");
+
+        start = benchClock::now();
+        ivfindex ivf(library.keys);
+        double buildMs = secondsSince(start) * 1e3;
+
+        for (int probes : {1, 2, 4, 8, 0}) {
+            long scanned = 0;
+            vector<RGBAPixel> results(queries.size());
+            start = benchClock::now();
+            for (size_t q = 0; q < queries.size(); q++) {
+                results[q] = ivf.findNearestNeighbor(queries[q], probes, &scanned);
+            }
+            double ns = secondsSince(start) * 1e9 / queries.size();
+
+            int hits = 0;
+            for (size_t q = 0; q < queries.size(); q++) {
+                hits += tree.distance3D(queries[q], results[q]) == tree.distance3D(queries[q], expected[q]);
+            }
+            if (probes == 0 && hits != (int) queries.size()) { printf("MISMATCH in exact mode\n"); }
+            printf("%-10s %8d %10.1f %-7s %10.0f %10.1f %8.1f\n", library.name, ivf.clusterCount(), buildMs,
+                   probes == 0 ? "exact" : to_string(probes).c_str(), ns, (double) scanned / queries.size(),
+                   100.0 * hits / queries.size());
+        }
+    }
+}
+
+/**
+ * vptree: CIEDE2000 matching with de2000index against a scan that evaluates
+ * deltaE2000 for every key -- build and query time, the metric evaluations a
+ * query makes, and answers worse than the scan's (a few, where deltaE2000
+ * breaks the triangle inequality). Then the same tree over
+ * cone coordinates with plain Euclidean distance, a true metric, which must
+ * agree with coneindex exactly.
+ */
+static void benchVPTree()
+{
+    const int QUERIES = 5000, SAMPLE = 200;
+    printf("%-8s %-8s %10s %10s %12s %9s %10s\n", "tiles", "metric", "build ms", "ns/query",
+           "evals/query", "% of lib", "mismatches");
+    double sink = 0;
+
+    for (int n : {1000, 10000, 100000}) {
+        map<RGBAPixel, string> photos = randomPhotos(n, 7);
+        vector<RGBAPixel> keys, queries = randomQueries(QUERIES, 8);
+        for (auto const & x : photos) { keys.push_back(x.first); }
+
+        auto start = benchClock::now();
+        de2000index index(photos);
+        double buildMs = secondsSince(start) * 1e3;
+
+        long evaluations = 0;
+        vector<RGBAPixel> results(QUERIES);
+        start = benchClock::now();
+        for (int q = 0; q < QUERIES; q++) { results[q] = index.findNearestNeighbor(queries[q], &evaluations); }
+        double treeNs = secondsSince(start) * 1e9 / QUERIES;
+
+        // the scan on a sample, counting answers that are farther than its own
+        vector<colorspace::labPoint> lab(keys.size());
+        colorspace::rgbToLab(keys.data(), keys.size(), lab.data());
+        int mismatches = 0;
+        start = benchClock::now();
+        for (int q = 0; q < SAMPLE; q++) {
+            colorspace::labPoint query = colorspace::rgbToLab(queries[q]);
+            float best = 1e9f;
+            for (const auto & p : lab) { best = min(best, colorspace::deltaE2000(query, p)); }
+            if (colorspace::deltaE2000(query, colorspace::rgbToLab(results[q])) > best) { mismatches++; }
+        }
+        double scanNs = secondsSince(start) * 1e9 / SAMPLE;
+
+        printf("%-8d %-8s %10s %10.0f %12d %9.1f %10s\n", n, "scan", "-", scanNs, n, 100.0, "-");
+        printf("%-8d %-8s %10.1f %10.0f %12.1f %9.1f %10d\n", n, "de2000", buildMs, treeNs,
+               (double) evaluations / QUERIES, 100.0 * evaluations / QUERIES / n, mismatches);
+
+        // the cone: Euclidean there is HSLAPixel::dist, as coneindex uses it
+        vector<colorspace::conePoint> cone(keys.size()), coneQueries(QUERIES);
+        colorspace::rgbToCone(keys.data(), keys.size(), cone.data());
+        colorspace::rgbToCone(queries.data(), QUERIES, coneQueries.data());
+        start = benchClock::now();
+        vptree<colorspace::conePoint, euclidean<float, 3> > coneTree(cone);
+        buildMs = secondsSince(start) * 1e3;
+        coneindex reference(photos);
+        evaluations = 0;
+        mismatches = 0;
+        start = benchClock::now();
+        for (int q = 0; q < QUERIES; q++) {
+            results[q] = keys[coneTree.findNearestNeighbor(coneQueries[q], &evaluations).id];
+        }
+        treeNs = secondsSince(start) * 1e9 / QUERIES;
+        for (int q = 0; q < QUERIES; q++) {
+            colorspace::conePoint mine = colorspace::rgbToCone(results[q]);
+            colorspace::conePoint theirs = colorspace::rgbToCone(reference.findNearestNeighbor(queries[q]));
+            if (squaredL2<float>::distance<3>(coneQueries[q], mine) !=
+                squaredL2<float>::distance<3>(coneQueries[q], theirs)) { mismatches++; }
+        }
+        printf("%-8d %-8s %10.1f %10.0f %12.1f %9.1f %10d\n", n, "cone", buildMs, treeNs,
+               (double) evaluations / QUERIES, 100.0 * evaluations / QUERIES / n, mismatches);
+        sink += results[0].r;
+    }
+    keep((size_t) (long) sink);
+}
+
+/**
+ * gray: grayindex against rgbtree on grayscale libraries, for gray queries
+ * and for color ones (a photo tiled with monochrome thumbnails) -- build
+ * time, query time, and answers farther than rgbtree's.
+ */
+static void benchGray()
+{
+    const int QUERIES = 200000;
+    printf("%-8s %-8s %10s %10s %10s %10s %10s\n", "tiles", "queries", "tree ms", "table ms",
+           "tree ns", "table ns", "mismatches");
+
+    for (int n : {64, 256, 100000}) {
+        // n thumbnails over the gray levels, repeats and all
+        minstd_rand rng(n);
+        vector<RGBAPixel> keys(n);
+        for (RGBAPixel & key : keys) { int v = rng() % 256; key = RGBAPixel(v, v, v); }
+
+        auto start = benchClock::now();
+        rgbtree tree(keys);
+        double treeMs = secondsSince(start) * 1e3;
+        start = benchClock::now();
+        grayindex gray(keys);
+        double grayMs = secondsSince(start) * 1e3;
+
+        vector<RGBAPixel> grayQueries(QUERIES);
+        for (RGBAPixel & q : grayQueries) { int v = rng() % 256; q = RGBAPixel(v, v, v); }
+        vector<pair<const char *, vector<RGBAPixel> > > querySets = {
+            { "gray", grayQueries }, { "color", randomQueries(QUERIES, 71) }
+        };
+        for (const auto & set : querySets) {
+            const vector<RGBAPixel> & queries = set.second;
+            vector<RGBAPixel> treeResults, grayResults;
+            start = benchClock::now();
+            tree.findNearestNeighbors(queries, treeResults);
+            double treeNs = secondsSince(start) * 1e9 / QUERIES;
+            start = benchClock::now();
+            gray.findNearestNeighbors(queries, grayResults);
+            double grayNs = secondsSince(start) * 1e9 / QUERIES;
+
+            int mismatches = 0;
+            for (int q = 0; q < QUERIES; q++) {
+                mismatches += tree.distance3D(queries[q], treeResults[q]) != tree.distance3D(queries[q], grayResults[q]);
+            }
+            printf("%-8d %-8s %10.2f %10.3f %10.1f %10.1f %10d\n", n, set.first, treeMs, grayMs,
+                   treeNs, grayNs, mismatches);
+        }
+    }
+}
+
+/**
+ * png: whole-image operations on mosaic-sized outputs -- copy construction,
+ * resize to a larger and to a smaller canvas, and a write and read back of a
+ * PNG file -- in ms per call. The picture is flat tiles with a little texture,
+ * so lodepng's compression sees something like a real mosaic.
+ */
+static void benchPNG()
+{
+    printf("%-8s %10s %10s %10s %10s %10s %10s\n", "side", "copy ms", "grow ms", "shrink ms",
+           "write ms", "read ms", "same");
+
+    const char * fileName = "bench_png.png";
+    for (unsigned side : {960u, 1920u, 3840u}) {
+        PNG image(side, side);
+        minstd_rand rng(side);
+        const unsigned TILE = 24;
+        for (unsigned ty = 0; ty < side; ty += TILE) {
+            for (unsigned tx = 0; tx < side; tx += TILE) {
+                RGBAPixel tile(rng() % 256, rng() % 256, rng() % 256);
+                for (unsigned y = ty; y < min(side, ty + TILE); y++) {
+                    for (unsigned x = tx; x < min(side, tx + TILE); x++) {
+                        RGBAPixel * p = image.getPixel(x, y);
+                        *p = tile;
+                        p->b ^= (x ^ y) & 7;
+                    }
+                }
+            }
+        }
+
+        const int REPS = side > 2000 ? 3 : 10;
+        double copyMs = 0, growMs = 0, shrinkMs = 0;
+        long sink = 0;
+        for (int rep = 0; rep < REPS; rep++) {
+            auto start = benchClock::now();
+            PNG copy(image);
+            copyMs += secondsSince(start) * 1e3;
+            sink += copy.getPixel(side - 1, side - 1)->r;
+
+            start = benchClock::now();
+            copy.resize(side + side / 4, side + side / 4);
+            growMs += secondsSince(start) * 1e3;
+
+            PNG small(image);
+            start = benchClock::now();
+            small.resize(side / 2, side / 3);
+            shrinkMs += secondsSince(start) * 1e3;
+            sink += copy.getPixel(side, side)->g + small.getPixel(0, 1)->b;
+        }
+        keep((size_t) sink);
+
+        auto start = benchClock::now();
+        image.writeToFile(fileName);
+        double writeMs = secondsSince(start) * 1e3;
+        PNG back;
+        start = benchClock::now();
+        back.readFromFile(fileName);
+        double readMs = secondsSince(start) * 1e3;
+        remove(fileName);
+
+        printf("%-8u %10.2f %10.2f %10.2f %10.1f %10.1f %10s\n", side, copyMs / REPS, growMs / REPS,
+               shrinkMs / REPS, writeMs, readMs, back.computeHash() == image.computeHash() ? "yes" : "no");
+    }
+}
+
+static const benchSection sections[] = {
+    { "build", benchBuild },
+    { "select", benchSelect },
+    { "order", benchOrder },
+    { "layout", benchLayout },
+    { "leaves", benchLeaves },
+    { "dynamic", benchDynamic },
+    { "approx", benchApprox },
+    { "radius", benchRadius },
+    { "warm", benchWarm },
+    { "packets", benchPackets },
+    { "grid", benchGrid },
+    { "ivf", benchIVF },
+    { "gray", benchGray },
+    { "blocks", benchBlocks },
+    { "lab", benchLab },
+    { "hsl", benchHSL },
+    { "vptree", benchVPTree },
+    { "png", benchPNG },
+};
+
+int main(int argc, char * argv[])
+{
+    for (const auto & section : sections) {
+        bool wanted = argc < 2;
+        for (int i = 1; i < argc; i++) { wanted = wanted || strcmp(argv[i], section.name) == 0; }
+        if (!wanted) { continue; }
+
+        printf("== %s\n", section.name);
+        section.run();
+        printf("\n");
+    }
+    return 0;
+}
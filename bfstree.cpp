@@ -0,0 +1,115 @@
+/**
+ * @file bfstree.cpp
+ * Implementation of bfstree class.
+ */
+
+#include "bfstree.h"
+
+#include <limits.h>
+
+using namespace std;
+
+// a hint only; compilers without the builtin just skip it
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void) (address))
+#endif
+
+// height of the midpoint tree over n keys: the right half is never smaller
+static int heightOf(int n)
+{
+  int height = 0;
+  for (; n > 0; n = n / 2) { height++; }
+  return height;
+}
+
+bfstree::bfstree(const map<RGBAPixel, string> & photos, unsigned threads)
+{
+  layout(rgbtree(photos, threads));
+}
+
+bfstree::bfstree(const rgbtree & source)
+{
+  layout(source);
+}
+
+void bfstree::layout(const rgbtree & source)
+{
+  //buckets aren't ordered inside, and tombstoned nodes would still be
+  //answers here: lay out a fully split tree over the live keys
+  if (source.leafSize > 1 || source.removedCount > 0)
+  {
+    vector<RGBAPixel> live;
+    live.reserve(source.liveSize());
+    for (size_t i = 0; i < source.tree.size(); i++)
+    {
+      if (source.live(i)) { live.push_back(source.tree[i]); }
+    }
+    layout(rgbtree(live));
+    return;
+  }
+
+  int n = source.tree.size();
+  size_t slots = ((size_t) 1 << heightOf(n)) - 1;
+  nodes.assign(slots, node{{0, 0, 0}, 0});
+  keys.assign(slots, RGBAPixel());
+  place(source, 0, n - 1, 0);
+}
+
+void bfstree::place(const rgbtree & source, int start, int end, size_t slot)
+{
+  if (start > end) { return; }
+
+  //the same midpoint rgbtree uses for this range
+  int median = (start + end) / 2;
+  const RGBAPixel & key = source.tree[median];
+  nodes[slot] = node{{key.r, key.g, key.b}, 1};
+  keys[slot] = key;
+
+  place(source, start, median - 1, 2 * slot + 1);
+  place(source, median + 1, end, 2 * slot + 2);
+}
+
+RGBAPixel bfstree::findNearestNeighbor(const RGBAPixel & query) const
+{
+  if (nodes.empty()) { return RGBAPixel(); }
+
+  int q[3] = { query.r, query.g, query.b };
+  int bestDistance = INT_MAX;
+  size_t bestSlot = 0;
+  search(q, 0, 0, bestDistance, bestSlot);
+  return keys[bestSlot];
+}
+
+void bfstree::search(const int query[3], size_t slot, int dimension,
+                     int & bestDistance, size_t & bestSlot) const
+{
+  if (slot >= nodes.size() || !nodes[slot].used) { return; }
+
+  //the grandchildren are 4 consecutive nodes: start pulling them in while
+  //this node and its children are examined
+  size_t grandchild = 4 * slot + 3;
+  if (grandchild < nodes.size()) { PREFETCH(&nodes[grandchild]); }
+
+  const node & here = nodes[slot];
+  int dr = query[0] - here.c[0], dg = query[1] - here.c[1], db = query[2] - here.c[2];
+  int distance = dr * dr + dg * dg + db * db;
+  if (distance < bestDistance)
+  {
+    bestDistance = distance;
+    bestSlot = slot;
+  }
+
+  //near side first, the far side only if the splitting plane is in reach
+  int diff = query[dimension] - here.c[dimension];
+  size_t nearChild = diff < 0 ? 2 * slot + 1 : 2 * slot + 2;
+  size_t farChild = diff < 0 ? 2 * slot + 2 : 2 * slot + 1;
+  int nextDimension = dimension == 2 ? 0 : dimension + 1;
+
+  search(query, nearChild, nextDimension, bestDistance, bestSlot);
+  if (diff * diff <= bestDistance)
+  {
+    search(query, farChild, nextDimension, bestDistance, bestSlot);
+  }
+}
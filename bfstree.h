@@ -0,0 +1,67 @@
+/**
+ *
+ * bfstree: rgbtree's kd tree in breadth-first (Eytzinger) order
+ *
+ */
+
+#ifndef _BFSTREE_H_
+#define _BFSTREE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "cs221util/RGBAPixel.h"
+#include "rgbtree.h"
+#include "nnindex.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * The same tree rgbtree builds -- same nodes, same splits -- stored in
+ * breadth-first order: the root at 0 and the children of node i at 2i+1 and
+ * 2i+2. In rgbtree's midpoint layout the first few levels of every search
+ * land in cache lines spread across the whole array; here the top four levels
+ * are the first 15 nodes, one 64-byte line, the next four levels a handful
+ * more, and both children of a node share a line so one prefetch covers
+ * them. Nodes are 4 bytes (r, g, b and an occupancy flag, since the midpoint
+ * tree isn't complete and leaves holes in the last levels).
+ */
+class bfstree : public nnindex {
+
+public:
+
+    /**
+     * Builds an rgbtree over the keys of photos and lays it out.
+     */
+    bfstree(const map<RGBAPixel, string> & photos, unsigned threads = 0);
+
+    /**
+     * Lays out an already-built rgbtree (rebuilding it over its live keys,
+     * without leaf buckets, if it has buckets or removed keys).
+     */
+    bfstree(const rgbtree & source);
+
+    /**
+     * Same answer (up to ties in distance) as rgbtree::findNearestNeighbor.
+     */
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query) const;
+
+    int size() const { return keys.size(); }
+
+private:
+
+    struct node {
+        unsigned char c[3];
+        unsigned char used;
+    };
+
+    void layout(const rgbtree & source);
+    void place(const rgbtree & source, int start, int end, size_t slot);
+    void search(const int query[3], size_t slot, int dimension,
+                int & bestDistance, size_t & bestSlot) const;
+
+    vector<node> nodes;        // breadth-first; slots past the end are empty
+    vector<RGBAPixel> keys;    // the original key of each used slot
+};
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file blocktree.cpp
+ * Implementation of blocktree class.
+ */
+
+#include <stdexcept>
+#include <string>
+#include "blocktree.h"
+
+using namespace std;
+
+// copies n descriptors of K bytes into kdtree points, tagging each with its index
+template <int K>
+static vector<kdpoint<unsigned char, K> > toPoints(const vector<unsigned char> & descriptors)
+{
+  vector<kdpoint<unsigned char, K> > points(descriptors.size() / K);
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    copy(descriptors.begin() + i * K, descriptors.begin() + (i + 1) * K, points[i].c);
+    points[i].id = i;
+  }
+  return points;
+}
+
+template <int K>
+static int nearestId(const kdtree<kdpoint<unsigned char, K>, K> & tree,
+                     const unsigned char * query, long * visited)
+{
+  if (tree.size() == 0)
+  { return -1; }
+
+  kdpoint<unsigned char, K> q;
+  copy(query, query + K, q.c);
+  q.id = -1;
+  return tree.findNearestNeighbor(q, visited).id;
+}
+
+blocktree::blocktree(const vector<unsigned char> & descriptors, int dims)
+  : dims(dims)
+{
+  switch (dims)
+  {
+    case 3:  tree3 = kdtree<kdpoint<unsigned char, 3>, 3>(toPoints<3>(descriptors)); break;
+    case 12: tree12 = kdtree<kdpoint<unsigned char, 12>, 12>(toPoints<12>(descriptors)); break;
+    case 27: tree27 = kdtree<kdpoint<unsigned char, 27>, 27>(toPoints<27>(descriptors)); break;
+    default:
+      throw invalid_argument("blocktree supports 3, 12 or 27 dimensions, not " + to_string(dims));
+  }
+}
+
+int blocktree::findNearestNeighbor(const unsigned char * query, long * visited) const
+{
+  switch (dims)
+  {
+    case 3:  return nearestId(tree3, query, visited);
+    case 12: return nearestId(tree12, query, visited);
+    case 27: return nearestId(tree27, query, visited);
+    default: return -1;
+  }
+}
+
+int blocktree::size() const
+{
+  return tree3.size() + tree12.size() + tree27.size();
+}
@@ -0,0 +1,63 @@
+/**
+ *
+ * blocktree: kd tree over sub-block color descriptors
+ *
+ */
+
+#ifndef _BLOCKTREE_H_
+#define _BLOCKTREE_H_
+
+#include <cstddef>
+#include <vector>
+#include "kdtree.h"
+using namespace std;
+
+/**
+ * A tile descriptor is the grid x grid array of mean colors of an image,
+ * flattened row-major as r, g, b per block, so a 2x2 grid gives a 12-D point
+ * and a 3x3 grid a 27-D point. Matching on descriptors instead of a single
+ * average keeps a thumbnail's internal structure (a dark top half, a bright
+ * corner) from fighting the region of the target it replaces.
+ *
+ * blocktree is the descriptor index: a kdtree over 8-bit coordinates whose
+ * dimension is picked at run time from the grid (1x1 -> 3-D, 2x2 -> 12-D,
+ * 3x3 -> 27-D). Each supported grid is its own compile-time instantiation of
+ * kdtree, so the distance loop and coordinate access are specialized to the
+ * dimension; blocktree only routes the call.
+ */
+class blocktree {
+
+public:
+
+    /**
+     * Builds the tree.
+     *
+     * @param descriptors n * dims bytes, descriptor i at [i*dims, (i+1)*dims).
+     * @param dims number of coordinates per descriptor: 3, 12 or 27.
+     * @throws invalid_argument for any other number of dimensions.
+     */
+    blocktree(const vector<unsigned char> & descriptors, int dims);
+
+    /**
+     * Finds the descriptor closest to query (squared Euclidean distance over all
+     * dims coordinates).
+     *
+     * @param query dims bytes.
+     * @param visited if not NULL, incremented by the number of nodes examined.
+     * @return the index (into the descriptors passed to the constructor) of the
+     *  nearest descriptor, or -1 if the tree is empty.
+     */
+    int findNearestNeighbor(const unsigned char * query, long * visited = NULL) const;
+
+    int size() const;
+    int dimensions() const { return dims; }
+
+private:
+
+    int dims;
+    kdtree<kdpoint<unsigned char, 3>, 3> tree3;
+    kdtree<kdpoint<unsigned char, 12>, 12> tree12;
+    kdtree<kdpoint<unsigned char, 27>, 27> tree27;
+};
+
+#endif
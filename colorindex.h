@@ -0,0 +1,75 @@
+/**
+ *
+ * colorindex: nearest neighbor matching in a converted color space
+ *
+ */
+
+#ifndef _COLORINDEX_H_
+#define _COLORINDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "cs221util/RGBAPixel.h"
+#include "kdtree.h"
+#include "nnindex.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * colorindex<Conversion>: a matching engine for any color space in which
+ * squared Euclidean distance is the distance wanted. The library's average
+ * colors are converted once, every query on arrival, and the two are matched
+ * in a float kdtree. Answers are the original sRGB keys, so an engine drops
+ * into tile() wherever rgbtree does. A Conversion provides
+ *   point_type:                 a kdpoint<float, 3>,
+ *   convert(pixel):             one pixel's coordinates, and
+ *   convert(pixels, n, out):    n pixels at once, out[i].id set to i,
+ * the batch form being the fast one.
+ */
+template <class Conversion>
+class colorindex : public nnindex {
+
+public:
+
+    typedef typename Conversion::point_type point_type;
+
+    /**
+     * Converts the keys of photos and builds the tree over them.
+     */
+    colorindex(const map<RGBAPixel, string> & photos)
+    {
+        for (auto const & x : photos) { keys.push_back(x.first); }
+
+        vector<point_type> points(keys.size());
+        Conversion::convert(keys.data(), keys.size(), points.data());
+        tree = kdtree<point_type, 3, squaredL2<float> >(points);
+    }
+
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query) const
+    {
+        return keys[tree.findNearestNeighbor(Conversion::convert(query)).id];
+    }
+
+    /**
+     * Converts the whole batch in one pass before searching.
+     */
+    void findNearestNeighbors(const vector<RGBAPixel> & queries,
+                              vector<RGBAPixel> & results) const
+    {
+        vector<point_type> points(queries.size());
+        Conversion::convert(queries.data(), queries.size(), points.data());
+
+        results.resize(queries.size());
+        for (size_t i = 0; i < queries.size(); i++) {
+            results[i] = keys[tree.findNearestNeighbor(points[i]).id];
+        }
+    }
+
+private:
+
+    vector<RGBAPixel> keys;   // library keys, indexed by point id
+    kdtree<point_type, 3, squaredL2<float> > tree;
+};
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * @file colorspace.cpp
+ * sRGB -> CIELAB and sRGB -> HSL cone conversions.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "colorspace.h"
+
+using namespace std;
+
+namespace colorspace {
+
+// sRGB primaries to XYZ, rows pre-divided by the D65 white point so the
+// result is already X/Xn, Y/Yn, Z/Zn
+static const float M[3][3] = {
+  { 0.4124564f / 0.95047f, 0.3575761f / 0.95047f, 0.1804375f / 0.95047f },
+  { 0.2126729f,            0.7151522f,            0.0721750f            },
+  { 0.0193339f / 1.08883f, 0.1191920f / 1.08883f, 0.9503041f / 1.08883f }
+};
+
+// Lab companding: cube root above (6/29)^3, linear segment below
+static const float EPSILON = 216.0f / 24389.0f;
+static const float KAPPA = 24389.0f / 27.0f;
+
+static inline float companding(float t)
+{
+  float cube = fastCbrt(t > EPSILON ? t : 1.0f);
+  float line = (KAPPA * t + 16.0f) / 116.0f;
+  return t > EPSILON ? cube : line;
+}
+
+labPoint rgbToLab(const RGBAPixel & pixel)
+{
+  labPoint out;
+  rgbToLab(&pixel, 1, &out);
+  out.id = 0;
+  return out;
+}
+
+void rgbToLab(const RGBAPixel * pixels, size_t n, labPoint * out)
+{
+  // fixed-size chunks keep the intermediates in L1 and give the compiler
+  // simple counted loops to vectorize
+  const size_t CHUNK = 256;
+  float r[CHUNK], g[CHUNK], b[CHUNK];
+  float fx[CHUNK], fy[CHUNK], fz[CHUNK];
+
+  for (size_t base = 0; base < n; base += CHUNK)
+  {
+    size_t count = n - base < CHUNK ? n - base : CHUNK;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      r[i] = SRGB_TO_LINEAR.value[pixels[base + i].r];
+      g[i] = SRGB_TO_LINEAR.value[pixels[base + i].g];
+      b[i] = SRGB_TO_LINEAR.value[pixels[base + i].b];
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      fx[i] = companding(M[0][0] * r[i] + M[0][1] * g[i] + M[0][2] * b[i]);
+      fy[i] = companding(M[1][0] * r[i] + M[1][1] * g[i] + M[1][2] * b[i]);
+      fz[i] = companding(M[2][0] * r[i] + M[2][1] * g[i] + M[2][2] * b[i]);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      labPoint & lab = out[base + i];
+      lab.c[0] = 116.0f * fy[i] - 16.0f;
+      lab.c[1] = 500.0f * (fx[i] - fy[i]);
+      lab.c[2] = 200.0f * (fy[i] - fz[i]);
+      lab.id = base + i;
+    }
+  }
+}
+
+// CIEDE2000 as in Sharma, Wu and Dalal (2005), in double and degrees
+float deltaE2000(const labPoint & first, const labPoint & second)
+{
+  const double PI = 3.14159265358979323846;
+  const double POW25_7 = 6103515625.0;   // 25^7
+  auto radians = [PI](double degrees) { return degrees * PI / 180.0; };
+
+  double L1 = first[0], a1 = first[1], b1 = first[2];
+  double L2 = second[0], a2 = second[1], b2 = second[2];
+
+  // a' stretches a near the neutral axis, where the eye is more sensitive
+  double meanC = (sqrt(a1 * a1 + b1 * b1) + sqrt(a2 * a2 + b2 * b2)) / 2;
+  double meanC7 = pow(meanC, 7);
+  double G = 0.5 * (1 - sqrt(meanC7 / (meanC7 + POW25_7)));
+  double ap1 = (1 + G) * a1, ap2 = (1 + G) * a2;
+  double C1 = sqrt(ap1 * ap1 + b1 * b1), C2 = sqrt(ap2 * ap2 + b2 * b2);
+  double h1 = (ap1 == 0 && b1 == 0) ? 0 : atan2(b1, ap1) * 180.0 / PI;
+  double h2 = (ap2 == 0 && b2 == 0) ? 0 : atan2(b2, ap2) * 180.0 / PI;
+  if (h1 < 0) { h1 += 360; }
+  if (h2 < 0) { h2 += 360; }
+
+  double dL = L2 - L1;
+  double dC = C2 - C1;
+  double dh = 0;
+  if (C1 * C2 != 0)
+  {
+    dh = h2 - h1;
+    if (dh > 180) { dh -= 360; }
+    else if (dh < -180) { dh += 360; }
+  }
+  double dH = 2 * sqrt(C1 * C2) * sin(radians(dh / 2));
+
+  double meanL = (L1 + L2) / 2;
+  double meanCp = (C1 + C2) / 2;
+  double meanH = h1 + h2;
+  if (C1 * C2 != 0)
+  {
+    if (fabs(h1 - h2) <= 180) { meanH /= 2; }
+    else { meanH = meanH < 360 ? (meanH + 360) / 2 : (meanH - 360) / 2; }
+  }
+
+  double T = 1 - 0.17 * cos(radians(meanH - 30)) + 0.24 * cos(radians(2 * meanH))
+               + 0.32 * cos(radians(3 * meanH + 6)) - 0.20 * cos(radians(4 * meanH - 63));
+  double dTheta = 30 * exp(-((meanH - 275) / 25) * ((meanH - 275) / 25));
+  double meanCp7 = pow(meanCp, 7);
+  double RC = 2 * sqrt(meanCp7 / (meanCp7 + POW25_7));
+  double L50 = (meanL - 50) * (meanL - 50);
+  double SL = 1 + 0.015 * L50 / sqrt(20 + L50);
+  double SC = 1 + 0.045 * meanCp;
+  double SH = 1 + 0.015 * meanCp * T;
+  double RT = -sin(radians(2 * dTheta)) * RC;
+
+  double l = dL / SL, c = dC / SC, h = dH / SH;
+  return (float) sqrt(max(0.0, l * l + c * c + h * h + RT * c * h));
+}
+
+// sine and cosine of the sector each largest channel starts at: red 0,
+// green 120, blue 240 degrees
+static const float SECTOR_SIN[3] = { 0.0f,  0.86602540f, -0.86602540f };
+static const float SECTOR_COS[3] = { 1.0f, -0.5f,        -0.5f        };
+
+conePoint rgbToCone(const RGBAPixel & pixel)
+{
+  conePoint out;
+  rgbToCone(&pixel, 1, &out);
+  out.id = 0;
+  return out;
+}
+
+void rgbToCone(const RGBAPixel * pixels, size_t n, conePoint * out)
+{
+  const size_t CHUNK = 256;
+  float offset[CHUNK], radius[CHUNK], light[CHUNK];
+  int sector[CHUNK];
+
+  for (size_t base = 0; base < n; base += CHUNK)
+  {
+    size_t count = n - base < CHUNK ? n - base : CHUNK;
+
+    // same case split as rgb2hsl (ties go to red, then green), written as
+    // selects: the hue is 120 * sector + 60 * t degrees with t in [-1, 1]
+    for (size_t i = 0; i < count; i++)
+    {
+      int r = pixels[base + i].r, g = pixels[base + i].g, b = pixels[base + i].b;
+      int hi = max(r, max(g, b)), lo = min(r, min(g, b));
+      int chroma = hi - lo;
+      int k = hi == r ? 0 : (hi == g ? 1 : 2);
+      int num = k == 0 ? g - b : (k == 1 ? b - r : r - g);
+
+      float l = (hi + lo) / 510.0f;
+      // s * l, with s = chroma / (1 - |2l - 1|); zero for grays
+      float denom = 255.0f - fabsf((float) (hi + lo) - 255.0f);
+      sector[i] = k;
+      offset[i] = chroma > 0 ? (float) num / chroma * 1.04719755f : 0.0f;
+      radius[i] = chroma > 0 ? chroma * l / denom : 0.0f;
+      light[i] = l;
+    }
+
+    // |offset| <= pi/3, where these series are good to ~1e-7
+    for (size_t i = 0; i < count; i++)
+    {
+      float x = offset[i], x2 = x * x;
+      float sn = x * (1.0f - x2 / 6.0f * (1.0f - x2 / 20.0f * (1.0f - x2 / 42.0f * (1.0f - x2 / 72.0f))));
+      float cs = 1.0f - x2 / 2.0f * (1.0f - x2 / 12.0f * (1.0f - x2 / 30.0f * (1.0f - x2 / 56.0f * (1.0f - x2 / 90.0f))));
+      float ss = SECTOR_SIN[sector[i]], sc = SECTOR_COS[sector[i]];
+
+      conePoint & cone = out[base + i];
+      cone.c[0] = radius[i] * (ss * cs + sc * sn);   // sin(sector + offset)
+      cone.c[1] = radius[i] * (sc * cs - ss * sn);   // cos(sector + offset)
+      cone.c[2] = light[i];
+      cone.id = base + i;
+    }
+  }
+}
+
+}
@@ -0,0 +1,141 @@
+/**
+ *
+ * colorspace: batch conversions from 8-bit sRGB to perceptual spaces
+ *
+ */
+
+#ifndef _COLORSPACE_H_
+#define _COLORSPACE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "cs221util/RGBAPixel.h"
+#include "kdtree.h"
+using namespace cs221util;
+
+namespace colorspace {
+
+/**
+ * A color in CIELAB (D65 white): L in [0, 100], a and b roughly [-128, 128].
+ * Squared Euclidean distance between two of these is the CIE76 delta E
+ * squared, which tracks perceived difference far better than raw sRGB.
+ */
+typedef kdpoint<float, 3> labPoint;
+
+/**
+ * constexpr helpers for building the sRGB decoding table at compile time;
+ * std::pow isn't constexpr, so x^2.4 is formed as x^2 * fifthroot(x^2).
+ */
+constexpr double fifthRoot(double a)
+{
+    double y = 1.0;
+    for (int i = 0; i < 64; i++) { y = (4.0 * y + a / (y * y * y * y)) / 5.0; }
+    return y;
+}
+
+constexpr double srgbToLinear(int value)
+{
+    double c = value / 255.0;
+    if (c <= 0.04045) { return c / 12.92; }
+    double x = (c + 0.055) / 1.055;
+    return x * x * fifthRoot(x * x);
+}
+
+/**
+ * Linear-light value of each 8-bit sRGB code, generated by the compiler.
+ */
+struct linearTable {
+    float value[256];
+
+    constexpr linearTable() : value()
+    {
+        for (int i = 0; i < 256; i++) { value[i] = (float) srgbToLinear(i); }
+    }
+};
+
+constexpr linearTable SRGB_TO_LINEAR{};
+
+/**
+ * Cube root for the Lab companding, t in (0, ~1.1]: an exponent-dividing bit
+ * trick gives a first guess within a few percent and two Newton steps take it
+ * to ~1e-6 relative error, well under one unit of L.
+ */
+inline float fastCbrt(float t)
+{
+    uint32_t bits;
+    memcpy(&bits, &t, sizeof(bits));
+    bits = bits / 3 + 709921077u;
+    float y;
+    memcpy(&y, &bits, sizeof(y));
+    y = y - (y * y * y - t) / (3.0f * y * y);
+    y = y - (y * y * y - t) / (3.0f * y * y);
+    return y;
+}
+
+/**
+ * Converts one sRGB pixel to Lab. The alpha channel is ignored.
+ */
+labPoint rgbToLab(const RGBAPixel & pixel);
+
+/**
+ * Converts n pixels to Lab. Tables replace pow() and fastCbrt replaces cbrt(),
+ * and the channels are processed as separate straight-line loops so the
+ * compiler can vectorize them.
+ *
+ * @param pixels n input pixels.
+ * @param n number of pixels.
+ * @param out n output points; each id is set to the pixel's index.
+ */
+void rgbToLab(const RGBAPixel * pixels, size_t n, labPoint * out);
+
+/**
+ * CIEDE2000 color difference between two Lab colors (kL = kC = kH = 1). It
+ * corrects CIE76 for the eye's uneven sensitivity -- to lightness away from
+ * mid-gray, to chroma differences among saturated colors, and to hue around
+ * blue -- but is not a sum of per-coordinate terms, so kdtree can't prune
+ * with it; vptree can. Strictly it isn't a metric either: the triangle
+ * inequality fails for some triples, mostly near the neutral axis where hue
+ * is unstable, so a vptree over it misses the true best for about 1% of
+ * random queries, settling for a match a few units worse.
+ */
+float deltaE2000(const labPoint & a, const labPoint & b);
+
+/**
+ * deltaE2000 as a vptree metric.
+ */
+struct ciede2000 {
+    typedef float value_type;
+
+    static float distance(const labPoint & a, const labPoint & b) { return deltaE2000(a, b); }
+};
+
+/**
+ * A color on the HSL cone: (s l sin h, s l cos h, l), the Cartesian point
+ * HSLAPixel::dist projects both of its arguments onto. Squared Euclidean
+ * distance between two of these is exactly HSLAPixel::dist, so the trig is
+ * paid once per color instead of four times per comparison.
+ */
+typedef kdpoint<float, 3> conePoint;
+
+/**
+ * Converts one sRGB pixel to cone coordinates. The alpha channel is ignored.
+ */
+conePoint rgbToCone(const RGBAPixel & pixel);
+
+/**
+ * Converts n pixels to cone coordinates without calling rgb2hsl or any trig
+ * function: the hue is split into the 120 degree sector of the largest
+ * channel plus an offset of at most 60 degrees, whose sine and cosine are
+ * short polynomials, and the sector is applied as a fixed rotation. The loops
+ * are branch-free so the compiler can vectorize them.
+ *
+ * @param pixels n input pixels.
+ * @param n number of pixels.
+ * @param out n output points; each id is set to the pixel's index.
+ */
+void rgbToCone(const RGBAPixel * pixels, size_t n, conePoint * out);
+
+}
+
+#endif
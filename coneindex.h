@@ -0,0 +1,33 @@
+/**
+ *
+ * coneindex: nearest neighbor matching on the HSL color cone
+ *
+ */
+
+#ifndef _CONEINDEX_H_
+#define _CONEINDEX_H_
+
+#include "colorspace.h"
+#include "colorindex.h"
+
+/**
+ * sRGB to HSL cone coordinates, as a colorindex conversion.
+ */
+struct coneConversion {
+    typedef colorspace::conePoint point_type;
+
+    static point_type convert(const RGBAPixel & pixel) { return colorspace::rgbToCone(pixel); }
+    static void convert(const RGBAPixel * pixels, size_t n, point_type * out)
+    {
+        colorspace::rgbToCone(pixels, n, out);
+    }
+};
+
+/**
+ * HSL matching engine: answers the same question as a linear scan with
+ * HSLAPixel::dist, since squared Euclidean distance between cone coordinates
+ * is the cone distance.
+ */
+typedef colorindex<coneConversion> coneindex;
+
+#endif
@@ -100,7 +100,7 @@ namespace cs221util {
     return out;
   }
 
-double HSLAPixel::dist(HSLAPixel p) const
+double HSLAPixel::dist(HSLAPixel const & p) const
 {
 return (sin(h*PI/180.)*s*l - sin(p.h*PI/180.)*p.s*p.l )
     *(sin(h*PI/180.)*s*l - sin(p.h*PI/180.)*p.s*p.l )
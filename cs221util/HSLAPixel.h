@@ -58,7 +58,7 @@ namespace cs221util {
    * distance operator for pixels. projects onto color cone and returns 
    * conical distance.
    **/
-  double dist(HSLAPixel p) const;
+  double dist(HSLAPixel const & p) const;
   };
 
 
@@ -11,21 +11,37 @@
 #include <algorithm>
 #include <functional>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <new>
 #include "lodepng/lodepng.h"
 #include "PNG.h"
 
 namespace cs221util {
+  // imageData_ is handed to and filled from lodepng as RGBA bytes
+  static_assert(offsetof(RGBAPixel, r) == 0 && offsetof(RGBAPixel, g) == 1 &&
+                offsetof(RGBAPixel, b) == 2 && offsetof(RGBAPixel, a) == 3,
+                "RGBAPixel channels must be laid out as RGBA bytes");
+
+  RGBAPixel * PNG::_allocate(size_t count) {
+    return static_cast<RGBAPixel *>(::operator new(count * sizeof(RGBAPixel)));
+  }
+
+  void PNG::_release(RGBAPixel * pixels) {
+    ::operator delete(pixels);
+  }
+
   void PNG::_copy(PNG const & other) {
+    size_t count = (size_t) other.width_ * other.height_;
+    RGBAPixel * copy = _allocate(count);
+    if (count > 0) { memcpy(copy, other.imageData_, count * sizeof(RGBAPixel)); }
+
     // Clear self
-    delete[] imageData_;
+    _release(imageData_);
 
-    // Copy `other` to self
     width_ = other.width_;
     height_ = other.height_;
-    imageData_ = new RGBAPixel[width_ * height_];
-    for (unsigned i = 0; i < width_ * height_; i++) {
-      imageData_[i] = other.imageData_[i];
-    }
+    imageData_ = copy;
   }
 
   PNG::PNG() {
@@ -37,7 +53,9 @@ namespace cs221util {
   PNG::PNG(unsigned int width, unsigned int height) {
     width_ = width;
     height_ = height;
-    imageData_ = new RGBAPixel[width * height];
+    size_t count = (size_t) width * height;
+    imageData_ = _allocate(count);
+    std::fill(imageData_, imageData_ + count, RGBAPixel());
   }
 
   PNG::PNG(PNG const & other) {
@@ -46,7 +64,7 @@ namespace cs221util {
   }
 
   PNG::~PNG() {
-    delete[] imageData_;
+    _release(imageData_);
   }
 
   PNG const & PNG::operator=(PNG const & other) {
@@ -107,38 +125,23 @@ namespace cs221util {
       return false;
     }
 
-    delete[] imageData_;
-    imageData_ = new RGBAPixel[width_ * height_];
-
-    for (unsigned i = 0; i < byteData.size(); i += 4) {
-      RGBAPixel rgb;
-      rgb.r = byteData[i];
-      rgb.g = byteData[i + 1];
-      rgb.b = byteData[i + 2];
-      rgb.a = byteData[i + 3];
-      imageData_[i/4] = rgb;
-    }
+    // the decoded bytes are RGBA pixels already
+    _release(imageData_);
+    imageData_ = _allocate((size_t) width_ * height_);
+    if (!byteData.empty()) { memcpy(imageData_, byteData.data(), byteData.size()); }
 
     return true;
   }
 
 
   bool PNG::writeToFile(string const & fileName) {
-    unsigned char *byteData = new unsigned char[width_ * height_ * 4];
-
-    for (unsigned i = 0; i < width_ * height_; i++) {
-      byteData[(i * 4)]     = imageData_[i].r;
-      byteData[(i * 4) + 1] = imageData_[i].g;
-      byteData[(i * 4) + 2] = imageData_[i].b;
-      byteData[(i * 4) + 3] = imageData_[i].a;
-    }
+    const unsigned char * byteData = reinterpret_cast<const unsigned char *>(imageData_);
 
     unsigned error = lodepng::encode(fileName, byteData, width_, height_);
     if (error) {
       cerr << "PNG encoding error " << error << ": " << lodepng_error_text(error) << endl;
     }
 
-    delete[] byteData;
     return (error == 0);
   }
 
@@ -151,23 +154,36 @@ namespace cs221util {
   }
 
   void PNG::resize(unsigned int newWidth, unsigned int newHeight) {
-    // Create a new vector to store the image data for the new (resized) image
-    RGBAPixel * newImageData = new RGBAPixel[newWidth * newHeight];
-
-    // Copy the current data to the new image data, using the existing pixel
-    // for coordinates within the bounds of the old image size
-    for (unsigned x = 0; x < newWidth; x++) {
-      for (unsigned y = 0; y < newHeight; y++) {
-        if (x < width_ && y < height_) {
-          RGBAPixel * oldPixel = this->getPixel(x, y);
-          RGBAPixel & newPixel = newImageData[ (x + (y * newWidth)) ];
-          newPixel = *oldPixel;
+    unsigned keepWidth = std::min(width_, newWidth);
+    unsigned keepHeight = std::min(height_, newHeight);
+
+    // Cropping only: close up the kept rows in place. Each moves toward the
+    // front, possibly over itself, so memmove
+    if (newWidth <= width_ && newHeight <= height_) {
+      if (newWidth < width_) {
+        for (unsigned y = 1; y < newHeight; y++) {
+          memmove(imageData_ + (size_t) y * newWidth, imageData_ + (size_t) y * width_,
+                  newWidth * sizeof(RGBAPixel));
         }
       }
+      width_ = newWidth;
+      height_ = newHeight;
+      return;
+    }
+
+    // Growing: copy the kept part of each row into new storage and fill the
+    // rest with default pixels
+    RGBAPixel * newImageData = _allocate((size_t) newWidth * newHeight);
+    for (unsigned y = 0; y < keepHeight; y++) {
+      RGBAPixel * row = newImageData + (size_t) y * newWidth;
+      if (keepWidth > 0) { memcpy(row, imageData_ + (size_t) y * width_, keepWidth * sizeof(RGBAPixel)); }
+      std::fill(row + keepWidth, row + newWidth, RGBAPixel());
     }
+    std::fill(newImageData + (size_t) keepHeight * newWidth,
+              newImageData + (size_t) newHeight * newWidth, RGBAPixel());
 
     // Clear the existing image
-    delete[] imageData_;
+    _release(imageData_);
 
     // Update the image to reflect the new image size and data
     width_ = newWidth;
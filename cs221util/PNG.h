@@ -110,7 +110,8 @@ namespace cs221util {
     /**
       * Resizes the image to the given coordinates. Attempts to preserve
       * existing pixel data in the image when doing so, but will crop if
-      * necessary. No pixel interpolation is done.
+      * necessary. No pixel interpolation is done. New pixels are black;
+      * shrinking keeps the current allocation.
       * @param newWidth New width of the image.
       * @param newHeight New height of the image.
       */
@@ -131,6 +132,14 @@ namespace cs221util {
      * Copeies the contents of `other` to self
      */
      void _copy(PNG const & other);
+
+    /**
+     * Raw storage for count pixels, left uninitialized: pixels are plain
+     * bytes, so every caller that overwrites them all skips the constructor
+     * pass. Released with _release.
+     */
+    static RGBAPixel * _allocate(size_t count);
+    static void _release(RGBAPixel * pixels);
   };
 
   std::ostream & operator<<(std::ostream & out, PNG const & pixel);
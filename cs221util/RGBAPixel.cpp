@@ -19,14 +19,6 @@ namespace cs221util {
     a = alpha;
   }
 
-  RGBAPixel & RGBAPixel::operator=(RGBAPixel const & other) {
-    this->r = other.r;
-    this->g = other.g;
-    this->b = other.b;
-    this->a = other.a;
-    return *this;
-  }
-
   bool RGBAPixel::operator== (RGBAPixel const & other) const {
     // thank/blame Wade for the following function
     // adapted by cinda to allow for slight deviations in RGB
@@ -45,21 +37,6 @@ namespace cs221util {
     return !(*this == other);
   }
 
-  bool RGBAPixel::operator<  (RGBAPixel const & other) const {
-    // Cinda is not sure where this is used. Fairly arb total
-    // order is reflected here. R->G->B.
-      if (*this == other) { return false; }
-
-      if (r < other.r)
-          return true;
-      else if ((r == other.r) && (g < other.g))
-          return true;
-      else if ((r == other.r) && (g == other.g) && (b < other.b))
-          return true;
-
-      return false;
-  }
-
   std::ostream & operator<<(std::ostream & out, RGBAPixel const & pixel) {
     out << "(" << pixel.r << ", " << pixel.g << ", " << pixel.b << (pixel.a != 1 ? ", " + std::to_string(pixel.a) : "") << ")";
 
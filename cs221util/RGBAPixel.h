@@ -8,8 +8,10 @@
 #ifndef CS221_RGBAPIXEL_H_
 #define CS221_RGBAPIXEL_H_
 
+#include <cstdint>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
 
 namespace cs221util {
   class RGBAPixel {
@@ -33,12 +35,48 @@ namespace cs221util {
      */
     RGBAPixel(int red=0, int green=0, int blue=0, int alpha=255);
 
-    RGBAPixel & operator=(RGBAPixel const & other);
+    /**
+     * Tolerant equality, meant for comparing images, not for keys. A fully
+     * transparent *this equals every other pixel, opaque ones included;
+     * otherwise the alphas must match and r, g and b may each differ by up
+     * to 2. It is neither symmetric (transparent == opaque, but not the
+     * other way round) nor transitive.
+     */
     bool operator== (RGBAPixel const & other) const ;
     bool operator!= (RGBAPixel const & other) const ;
-    bool operator<  (RGBAPixel const & other) const ;
+
+    /**
+     * Exact order, by red, then green, then blue, then alpha: a single
+     * compare of the packed keys. A strict weak ordering, as std::map and
+     * sorting need; two pixels are equivalent under it only when all four
+     * channels match.
+     */
+    bool operator<  (RGBAPixel const & other) const { return key() < other.key(); }
+
+    /**
+     * The pixel packed into one integer, red in the high byte, then green,
+     * blue and alpha, so that integer order is the order of operator<.
+     */
+    uint32_t key() const {
+      return (uint32_t) r << 24 | (uint32_t) g << 16 | (uint32_t) b << 8 | a;
+    }
+
+    /**
+     * Red, green and blue packed into the low 24 bits: the color without
+     * its alpha, in the same order.
+     */
+    uint32_t rgb() const { return key() >> 8; }
   };
 
+  /*
+   * Copies, assignments and destruction are the compiler's: a pixel is four
+   * plain bytes, r, g, b, a in that order, so PNG moves whole pixel arrays
+   * with memcpy and hands them to lodepng as RGBA bytes without converting.
+   */
+  static_assert(std::is_trivially_copyable<RGBAPixel>::value, "RGBAPixel must be trivially copyable");
+  static_assert(std::is_standard_layout<RGBAPixel>::value, "RGBAPixel must be standard layout");
+  static_assert(sizeof(RGBAPixel) == 4, "RGBAPixel must be exactly four bytes");
+
   /**
    * Stream operator that allows pixels to be written to standard streams
    * (like cout).
@@ -0,0 +1,56 @@
+/**
+ * @file de2000index.cpp
+ * Implementation of de2000index class.
+ */
+
+#include <algorithm>
+#include "de2000index.h"
+#include "parallel.h"
+
+de2000index::de2000index(const map<RGBAPixel, string> & photos, unsigned threads)
+  : threads(threads)
+{
+  for (auto const & x : photos)
+  {
+    keys.push_back(x.first);
+  }
+  build();
+}
+
+de2000index::de2000index(const vector<RGBAPixel> & keys, unsigned threads)
+  : threads(threads), keys(keys)
+{
+  build();
+}
+
+void de2000index::build()
+{
+  vector<colorspace::labPoint> points(keys.size());
+  colorspace::rgbToLab(keys.data(), keys.size(), points.data());
+  tree = vptree<colorspace::labPoint, colorspace::ciede2000>(points, threads);
+}
+
+RGBAPixel de2000index::findNearestNeighbor(const RGBAPixel & query) const
+{
+  return findNearestNeighbor(query, NULL);
+}
+
+RGBAPixel de2000index::findNearestNeighbor(const RGBAPixel & query, long * evaluations) const
+{
+  return keys[tree.findNearestNeighbor(colorspace::rgbToLab(query), evaluations).id];
+}
+
+void de2000index::findNearestNeighbors(const vector<RGBAPixel> & queries,
+                                       vector<RGBAPixel> & results) const
+{
+  vector<colorspace::labPoint> points(queries.size());
+  colorspace::rgbToLab(queries.data(), queries.size(), points.data());
+
+  //blocks big enough that a worker's share outweighs handing it out
+  const size_t BLOCK = 256;
+  results.resize(queries.size());
+  parallel::parallelFor((queries.size() + BLOCK - 1) / BLOCK, threads, [&](size_t b) {
+    size_t to = min(queries.size(), (b + 1) * BLOCK);
+    for (size_t i = b * BLOCK; i < to; i++) { results[i] = keys[tree.findNearestNeighbor(points[i]).id]; }
+  });
+}
@@ -0,0 +1,72 @@
+/**
+ *
+ * de2000index: nearest neighbor matching by CIEDE2000
+ *
+ */
+
+#ifndef _DE2000INDEX_H_
+#define _DE2000INDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "cs221util/RGBAPixel.h"
+#include "colorspace.h"
+#include "nnindex.h"
+#include "vptree.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * Perceptual matching engine for the CIE's current color difference formula.
+ * The library's average colors are converted once to Lab and kept in a
+ * vptree under colorspace::deltaE2000, which isn't coordinate-wise and so
+ * can't go in a kdtree; the vantage points let a query skip most of the
+ * library. Because deltaE2000 isn't quite a metric the answers are very
+ * nearly, not always, the closest (see colorspace::deltaE2000). Answers are
+ * the original sRGB keys; of equally close keys the one first in the library
+ * wins (for a photos map, the smaller key).
+ */
+class de2000index : public nnindex {
+
+public:
+
+    /**
+     * Converts the keys of photos to Lab and builds the tree over them.
+     *
+     * @param threads workers for the build and batch queries; 0 means all.
+     */
+    de2000index(const map<RGBAPixel, string> & photos, unsigned threads = 0);
+
+    /**
+     * Indexes the given keys, for callers without a photos map.
+     */
+    de2000index(const vector<RGBAPixel> & keys, unsigned threads = 0);
+
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query) const;
+
+    /**
+     * @param evaluations if not NULL, incremented by the deltaE2000 calls made.
+     */
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query, long * evaluations) const;
+
+    /**
+     * Converts the whole batch to Lab in one vectorized pass, then searches
+     * it in blocks spread over threads.
+     */
+    void findNearestNeighbors(const vector<RGBAPixel> & queries,
+                              vector<RGBAPixel> & results) const;
+
+    /** Number of keys. */
+    int size() const { return (int) keys.size(); }
+
+private:
+
+    unsigned threads;
+    vector<RGBAPixel> keys;   // library keys, indexed by point id
+    vptree<colorspace::labPoint, colorspace::ciede2000> tree;
+
+    void build();
+};
+
+#endif
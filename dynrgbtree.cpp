@@ -0,0 +1,111 @@
+/**
+ * @file dynrgbtree.cpp
+ * Implementation of dynrgbtree class.
+ */
+
+#include "dynrgbtree.h"
+
+#include <limits.h>
+
+// smaller levels are rebuilt all the time; only big ones are worth threads
+static const size_t PARALLEL_LEVEL = 1 << 16;
+
+dynrgbtree::dynrgbtree()
+  : live(0), dead(0)
+{
+}
+
+dynrgbtree::dynrgbtree(const map<RGBAPixel, string> & photos)
+  : live(0), dead(0)
+{
+  vector<RGBAPixel> keys;
+  for (auto const & x : photos)
+  {
+    keys.push_back(x.first);
+  }
+  live = keys.size();
+
+  size_t level = 0;
+  while (((size_t) 1 << level) < keys.size()) { level++; }
+  levels.resize(level + 1);
+  if (!keys.empty()) { levels[level] = buildLevel(keys); }
+}
+
+unique_ptr<rgbtree> dynrgbtree::buildLevel(const vector<RGBAPixel> & keys)
+{
+  return unique_ptr<rgbtree>(new rgbtree(keys, keys.size() >= PARALLEL_LEVEL ? 0 : 1));
+}
+
+// the live keys of one level
+void dynrgbtree::collect(const rgbtree & level, vector<RGBAPixel> & keys) const
+{
+  for (size_t i = 0; i < level.tree.size(); i++)
+  {
+    if (level.live(i)) { keys.push_back(level.tree[i]); }
+  }
+}
+
+void dynrgbtree::insert(const RGBAPixel & key)
+{
+  //binary counter: empty every occupied level up to the first free one and
+  //rebuild their keys, plus the new one, there
+  vector<RGBAPixel> carry(1, key);
+  size_t level = 0;
+  for (; level < levels.size() && levels[level]; level++)
+  {
+    dead -= levels[level]->tree.size() - levels[level]->liveSize();
+    collect(*levels[level], carry);
+    levels[level].reset();
+  }
+  if (level == levels.size()) { levels.resize(level + 1); }
+
+  levels[level] = buildLevel(carry);
+  live++;
+}
+
+bool dynrgbtree::remove(const RGBAPixel & key)
+{
+  for (auto & level : levels)
+  {
+    if (level && level->remove(key))
+    {
+      live--;
+      dead++;
+      if (dead > live) { rebuildAll(); }
+      return true;
+    }
+  }
+  return false;
+}
+
+// every live key into the one level that fits them all
+void dynrgbtree::rebuildAll()
+{
+  vector<RGBAPixel> keys;
+  for (auto & level : levels)
+  {
+    if (level) { collect(*level, keys); }
+  }
+  levels.clear();
+  dead = 0;
+  if (keys.empty()) { return; }
+
+  size_t level = 0;
+  while (((size_t) 1 << level) < keys.size()) { level++; }
+  levels.resize(level + 1);
+  levels[level] = buildLevel(keys);
+}
+
+RGBAPixel dynrgbtree::findNearestNeighbor(const RGBAPixel & query) const
+{
+  RGBAPixel best;
+  int bestDistance = INT_MAX;
+
+  //largest level first: its answer is usually the final one, and its
+  //distance bounds the searches of all the smaller levels
+  for (size_t i = levels.size(); i-- > 0; )
+  {
+    if (levels[i]) { levels[i]->findNearestNeighbor(query, best, bestDistance); }
+  }
+  return best;
+}
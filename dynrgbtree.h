@@ -0,0 +1,76 @@
+/**
+ *
+ * dynrgbtree: an rgbtree that takes inserts and deletes
+ *
+ */
+
+#ifndef _DYNRGBTREE_H_
+#define _DYNRGBTREE_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cs221util/RGBAPixel.h"
+#include "rgbtree.h"
+#include "nnindex.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * The logarithmic method over static rgbtrees. Level i is either empty or a
+ * tree built over at most 2^i keys. An insert carries the new key up like a
+ * binary counter: the occupied levels below the first empty one are merged
+ * with it and rebuilt there, so each key is rebuilt O(log n) times and an
+ * insert costs O(log^2 n) amortized. A delete is a tombstone in whichever
+ * tree holds the key (rgbtree::remove); once tombstones outnumber live keys
+ * everything is rebuilt into one tree, which keeps deletes O(log^2 n)
+ * amortized too.
+ *
+ * A query asks every non-empty level and keeps the closest answer. The
+ * largest tree holds at least half the keys and dominates the cost, so a
+ * query is a few small searches more than the static tree's.
+ */
+class dynrgbtree : public nnindex {
+
+public:
+
+    dynrgbtree();
+
+    /**
+     * Starts with the keys of photos in a single tree.
+     */
+    dynrgbtree(const map<RGBAPixel, string> & photos);
+
+    /**
+     * Adds key. Adding a key that is already present stores a second copy.
+     */
+    void insert(const RGBAPixel & key);
+
+    /**
+     * Deletes one copy of key (exact in all four channels).
+     *
+     * @return false if key isn't present.
+     */
+    bool remove(const RGBAPixel & key);
+
+    /**
+     * The closest live key. The answer is RGBAPixel() when the tree is empty.
+     */
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query) const;
+
+    /** Number of live keys. */
+    int size() const { return live; }
+
+private:
+
+    void collect(const rgbtree & level, vector<RGBAPixel> & keys) const;
+    void rebuildAll();
+    static unique_ptr<rgbtree> buildLevel(const vector<RGBAPixel> & keys);
+
+    vector<unique_ptr<rgbtree> > levels;  // levels[i]: NULL or at most 2^i keys
+    int live;                             // keys not removed, over all levels
+    int dead;                             // tombstones, over all levels
+};
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * @file grayindex.cpp
+ * Implementation of grayindex class.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include "grayindex.h"
+
+grayindex::grayindex(const map<RGBAPixel, string> & photos)
+{
+  vector<RGBAPixel> keys;
+  for (auto const & x : photos)
+  {
+    keys.push_back(x.first);
+  }
+  build(keys);
+}
+
+grayindex::grayindex(const vector<RGBAPixel> & keys)
+{
+  build(keys);
+}
+
+bool grayindex::accepts(const map<RGBAPixel, string> & photos)
+{
+  for (auto const & x : photos)
+  {
+    if (x.first.r != x.first.g || x.first.g != x.first.b) { return false; }
+  }
+  return true;
+}
+
+void grayindex::build(vector<RGBAPixel> keys)
+{
+  bool gray = true;
+  for (const RGBAPixel & key : keys) { gray = gray && key.r == key.g && key.g == key.b; }
+  if (!gray) { cerr << "WARNING: grayindex given keys that aren't gray; matching by their red channel" << endl; }
+
+  //one key per level, the first given
+  stable_sort(keys.begin(), keys.end(), [](const RGBAPixel & a, const RGBAPixel & b) { return a.r < b.r; });
+  keys.erase(unique(keys.begin(), keys.end(), [](const RGBAPixel & a, const RGBAPixel & b) { return a.r == b.r; }),
+             keys.end());
+  if (keys.empty())
+  {
+    fill(nearest, nearest + 3 * 255 + 1, RGBAPixel());
+    return;
+  }
+
+  //sums only grow, so the best level only moves up: one sweep. Comparing
+  //3v against s keeps it in integers; on a tie the darker level stays
+  size_t k = 0;
+  for (int s = 0; s <= 3 * 255; s++)
+  {
+    while (k + 1 < keys.size() && abs(3 * keys[k + 1].r - s) < abs(3 * keys[k].r - s)) { k++; }
+    nearest[s] = keys[k];
+  }
+}
+
+RGBAPixel grayindex::findNearestNeighbor(const RGBAPixel & query) const
+{
+  return nearest[query.r + query.g + query.b];
+}
+
+void grayindex::findNearestNeighbors(const vector<RGBAPixel> & queries,
+                                     vector<RGBAPixel> & results) const
+{
+  results.resize(queries.size());
+  for (size_t i = 0; i < queries.size(); i++)
+  {
+    results[i] = nearest[queries[i].r + queries[i].g + queries[i].b];
+  }
+}
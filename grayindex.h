@@ -0,0 +1,63 @@
+/**
+ *
+ * grayindex: constant-time matching for grayscale libraries
+ *
+ */
+
+#ifndef _GRAYINDEX_H_
+#define _GRAYINDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "cs221util/RGBAPixel.h"
+#include "nnindex.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * Exact sRGB matching engine for libraries whose keys are all gray
+ * (r == g == b), like a monochrome product line's. A gray key (v, v, v) is
+ * at squared distance 3 (v - s/3)^2 + c from a query whose channels sum to s,
+ * with c the same for every key, so the nearest key depends on s alone. The
+ * constructor answers all 766 sums once, sweeping the sorted keys, and a
+ * query -- gray or not -- is one table lookup instead of a 3-D tree walk.
+ * Equally close keys are settled by the darker one, not by rgbtree's
+ * traversal order, so on a tie the tile can differ from rgbtree's.
+ */
+class grayindex : public nnindex {
+
+public:
+
+    /**
+     * Indexes the keys of photos, which should all be gray; other keys are
+     * matched by their red channel, with a warning.
+     */
+    grayindex(const map<RGBAPixel, string> & photos);
+
+    /**
+     * Indexes the given keys, for callers without a photos map.
+     */
+    grayindex(const vector<RGBAPixel> & keys);
+
+    /**
+     * Whether every key of photos is gray, so grayindex can take them.
+     */
+    static bool accepts(const map<RGBAPixel, string> & photos);
+
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query) const;
+
+    /**
+     * Batch form: the lookups, in one straight loop.
+     */
+    void findNearestNeighbors(const vector<RGBAPixel> & queries,
+                              vector<RGBAPixel> & results) const;
+
+private:
+
+    RGBAPixel nearest[3 * 255 + 1];   // the answer for each channel sum
+
+    void build(vector<RGBAPixel> keys);
+};
+
+#endif
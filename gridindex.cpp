@@ -0,0 +1,204 @@
+/**
+ * @file gridindex.cpp
+ * Implementation of gridindex class.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include "gridindex.h"
+
+gridindex::gridindex(const map<RGBAPixel, string> & photos, int side)
+{
+  vector<RGBAPixel> input;
+  input.reserve(photos.size());
+  for (auto const & x : photos)
+  {
+    input.push_back(x.first);
+  }
+  build(input, side);
+}
+
+gridindex::gridindex(const vector<RGBAPixel> & keys, int side)
+{
+  build(keys, side);
+}
+
+void gridindex::build(const vector<RGBAPixel> & input, int cells)
+{
+  if (cells != 0 && (cells < 1 || cells > 256 || (cells & (cells - 1)) != 0))
+  {
+    cerr << "WARNING: gridindex side must be a power of two from 1 to 256, not " << cells
+         << "; choosing one" << endl;
+    cells = 0;
+  }
+  if (cells == 0)
+  {
+    //about two keys per cell
+    cells = 4;
+    while (cells < 64 && 2 * (size_t) cells * cells * cells < input.size()) { cells *= 2; }
+  }
+  side = cells;
+  shift = 0;
+  while ((256 >> shift) > side) { shift++; }
+
+  //counting sort by cell: a histogram, its prefix sums, then a stable scatter
+  int total = side * side * side;
+  cellStart.assign(total + 1, 0);
+  vector<int> cellOf(input.size());
+  for (size_t i = 0; i < input.size(); i++)
+  {
+    cellOf[i] = cellIndex(input[i].r >> shift, input[i].g >> shift, input[i].b >> shift);
+    cellStart[cellOf[i] + 1]++;
+  }
+  for (int c = 0; c < total; c++) { cellStart[c + 1] += cellStart[c]; }
+
+  vector<int> next(cellStart.begin(), cellStart.end() - 1);
+  keys.resize(input.size());
+  for (size_t i = 0; i < input.size(); i++) { keys[next[cellOf[i]]++] = input[i]; }
+
+  occupied.clear();
+  for (int c = 0; c < total; c++)
+  {
+    if (cellStart[c] < cellStart[c + 1]) { occupied.push_back(c); }
+  }
+
+  for (int c = 0; c < 3; c++) { channels[c].resize(keys.size()); }
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    channels[0][i] = keys[i].r;
+    channels[1][i] = keys[i].g;
+    channels[2][i] = keys[i].b;
+  }
+}
+
+/**
+ * All distances of the cell first, in a branch-free loop over the channel
+ * arrays the compiler can vectorize, then the minimum.
+ */
+void gridindex::scanCell(int cell, const RGBAPixel & query, int & best, int & bestIndex) const
+{
+  const int CHUNK = 64;
+  int distances[CHUNK];
+  int qr = query.r, qg = query.g, qb = query.b;
+
+  for (int base = cellStart[cell]; base < cellStart[cell + 1]; base += CHUNK)
+  {
+    int count = min(CHUNK, cellStart[cell + 1] - base);
+    const unsigned char * r = &channels[0][base];
+    const unsigned char * g = &channels[1][base];
+    const unsigned char * b = &channels[2][base];
+    for (int j = 0; j < count; j++)
+    {
+      int dr = qr - r[j], dg = qg - g[j], db = qb - b[j];
+      distances[j] = dr * dr + dg * dg + db * db;
+    }
+
+    for (int j = 0; j < count; j++)
+    {
+      if (distances[j] < best ||
+          (distances[j] == best && keys[base + j].rgb() < keys[bestIndex].rgb()))
+      {
+        best = distances[j];
+        bestIndex = base + j;
+      }
+    }
+  }
+}
+
+int gridindex::cellDistance(int cell, const int * q) const
+{
+  int total = 0;
+  for (int a = 0; a < 3; a++)
+  {
+    int lo = coordinate(cell, a) << shift, hi = lo + (1 << shift) - 1;
+    int d = q[a] < lo ? lo - q[a] : (q[a] > hi ? q[a] - hi : 0);
+    total += d * d;
+  }
+  return total;
+}
+
+int gridindex::chebyshev(int cell, const int * home) const
+{
+  int far = 0;
+  for (int a = 0; a < 3; a++) { far = max(far, abs(coordinate(cell, a) - home[a])); }
+  return far;
+}
+
+RGBAPixel gridindex::findNearestNeighbor(const RGBAPixel & query) const
+{
+  if (keys.empty()) { return RGBAPixel(); }
+
+  int q[3] = { query.r, query.g, query.b };
+  int home[3];
+  for (int a = 0; a < 3; a++) { home[a] = q[a] >> shift; }
+  int width = 1 << shift;
+
+  int best = INT_MAX;
+  int bestIndex = -1;
+  for (int ring = 0; ring < side; ring++)
+  {
+    //a shell with more cells than are occupied: check those instead, skipping
+    //the ones inside the rings already scanned. The nearest goes first, for
+    //a tight bound; after it, only cells the bound still reaches are scanned
+    long shell = ring == 0 ? 1 : (long) (2 * ring + 1) * (2 * ring + 1) * (2 * ring + 1)
+                                 - (long) (2 * ring - 1) * (2 * ring - 1) * (2 * ring - 1);
+    if (shell > (long) occupied.size())
+    {
+      int nearest = -1, nearestDistance = INT_MAX;
+      for (int cell : occupied)
+      {
+        int d = cellDistance(cell, q);
+        if (d < nearestDistance && chebyshev(cell, home) >= ring) { nearest = cell; nearestDistance = d; }
+      }
+      if (nearest >= 0 && nearestDistance <= best) { scanCell(nearest, query, best, bestIndex); }
+      for (int cell : occupied)
+      {
+        if (cell != nearest && cellDistance(cell, q) <= best && chebyshev(cell, home) >= ring)
+        {
+          scanCell(cell, query, best, bestIndex);
+        }
+      }
+      break;
+    }
+
+    //the cells at Chebyshev distance ring from home, clipped to the cube
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; a++)
+    {
+      lo[a] = max(0, home[a] - ring);
+      hi[a] = min(side - 1, home[a] + ring);
+    }
+    for (int x = lo[0]; x <= hi[0]; x++)
+    {
+      bool xEdge = x == home[0] - ring || x == home[0] + ring;
+      for (int y = lo[1]; y <= hi[1]; y++)
+      {
+        bool edge = xEdge || y == home[1] - ring || y == home[1] + ring;
+        //inside the ring only the two z faces are new
+        int step = edge ? 1 : 2 * ring;
+        for (int z = edge ? lo[2] : home[2] - ring; z <= hi[2]; z += step)
+        {
+          if (z < 0) { continue; }
+          int cell = cellIndex(x, y, z);
+          if (cellStart[cell] < cellStart[cell + 1]) { scanCell(cell, query, best, bestIndex); }
+        }
+      }
+    }
+
+    //every key not scanned yet lies outside the box of rings 0..ring: at
+    //least as far as the nearest face of the box that isn't the cube's own
+    int gap = INT_MAX;
+    for (int a = 0; a < 3; a++)
+    {
+      if (lo[a] > 0) { gap = min(gap, q[a] - lo[a] * width + 1); }
+      if (hi[a] < side - 1) { gap = min(gap, (hi[a] + 1) * width - q[a]); }
+    }
+    if (gap == INT_MAX) { break; }
+    //equal distance still goes on: a tie outside may have the smaller color
+    if (bestIndex >= 0 && (long) gap * gap > best) { break; }
+  }
+
+  return keys[bestIndex];
+}
@@ -0,0 +1,85 @@
+/**
+ *
+ * gridindex: nearest neighbor matching in a uniform grid over the RGB cube
+ *
+ */
+
+#ifndef _GRIDINDEX_H_
+#define _GRIDINDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "cs221util/RGBAPixel.h"
+#include "nnindex.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * Exact sRGB matching engine for the bounded 8-bit cube. The cube is cut
+ * into side^3 equal cells and the keys are stored cell by cell, channels in
+ * separate arrays. A query scans its own cell, then rings of cells around it
+ * (the cells at Chebyshev distance 1, 2, ...), until the best key found is
+ * provably closer than anything outside the rings scanned. With keys spread
+ * over the cube that is a ring or two: expected O(1), with memory reads that
+ * are short contiguous runs instead of a walk down a tree. Far from a
+ * clustered library the rings would cross mostly empty cells, so once a ring
+ * has more cells than the library has occupied ones, the search checks the
+ * occupied cells directly instead.
+ *
+ * Answers are exact nearest neighbors by squared RGB distance, like
+ * rgbtree's; equally close keys are settled by the smaller packed color
+ * (r, then g, then b), whatever order the cells were scanned in.
+ */
+class gridindex : public nnindex {
+
+public:
+
+    /**
+     * Indexes the keys of photos.
+     *
+     * @param side cells per axis, a power of two from 1 to 256; 0 picks one
+     *  from the number of keys, about two keys per cell, between 4 and 64.
+     */
+    gridindex(const map<RGBAPixel, string> & photos, int side = 0);
+
+    /**
+     * Indexes the given keys, for callers without a photos map.
+     */
+    gridindex(const vector<RGBAPixel> & keys, int side = 0);
+
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query) const;
+
+    /** Cells per axis. */
+    int cellsPerAxis() const { return side; }
+
+    /** Number of keys. */
+    int size() const { return (int) keys.size(); }
+
+private:
+
+    int side;    // cells per axis
+    int shift;   // channel >> shift is the cell coordinate
+
+    /* keys grouped by cell: those of cell i are [cellStart[i], cellStart[i+1]),
+     * cells numbered (x * side + y) * side + z */
+    vector<int> cellStart;
+    vector<RGBAPixel> keys;
+    vector<unsigned char> channels[3];
+    vector<int> occupied;   // the cells holding keys, in cell order
+
+    void build(const vector<RGBAPixel> & input, int side);
+    int cellIndex(int x, int y, int z) const { return (x * side + y) * side + z; }
+    int coordinate(int cell, int axis) const { return cell >> ((2 - axis) * (8 - shift)) & (side - 1); }
+
+    /* brute force over one cell, best and bestIndex updated in place */
+    void scanCell(int cell, const RGBAPixel & query, int & best, int & bestIndex) const;
+
+    /* squared distance from query to the nearest color in cell */
+    int cellDistance(int cell, const int * q) const;
+
+    /* how many rings out from the cell home the cell is */
+    int chebyshev(int cell, const int * home) const;
+};
+
+#endif
@@ -0,0 +1,358 @@
+/**
+ * @file ivfindex.cpp
+ * Implementation of ivfindex class.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include "ivfindex.h"
+#include "kdtree.h"
+#include "parallel.h"
+
+typedef kdpoint<float, 3> centroidPoint;
+
+//k-means trains on at most this many keys, an even stride through the input
+static const size_t TRAINING = 65536;
+//Lloyd iterations, fewer if an assignment pass changes nothing
+static const int ITERATIONS = 8;
+//keys per task in the parallel passes
+static const size_t BLOCK = 4096;
+//keys per distance pass in a cluster scan
+static const int CHUNK = 64;
+
+ivfindex::ivfindex(const map<RGBAPixel, string> & photos, int clusters, int probes, unsigned threads)
+  : probes(probes), threads(threads)
+{
+  vector<RGBAPixel> input;
+  input.reserve(photos.size());
+  for (auto const & x : photos)
+  {
+    input.push_back(x.first);
+  }
+  build(input, clusters);
+}
+
+ivfindex::ivfindex(const vector<RGBAPixel> & keys, int clusters, int probes, unsigned threads)
+  : probes(probes), threads(threads)
+{
+  build(keys, clusters);
+}
+
+////////////////////////////////////// BUILD + HELPERS
+
+static uint32_t mortonCode(const RGBAPixel & pixel)
+{
+  uint32_t code = 0;
+  for (int bit = 7; bit >= 0; bit--)
+  {
+    code = (code << 3) | ((pixel.r >> bit) & 1) << 2 | ((pixel.g >> bit) & 1) << 1 | ((pixel.b >> bit) & 1);
+  }
+  return code;
+}
+
+/**
+ * Sets assignment[i] to the nearest of centroids for every point, through a
+ * kd tree over the centroids, in parallel. Returns how many changed.
+ */
+static size_t assign(const vector<RGBAPixel> & points, const vector<centroidPoint> & centroids,
+                     vector<int> & assignment, unsigned threads)
+{
+  kdtree<centroidPoint, 3, squaredL2<float> > tree(centroids);
+  size_t blocks = (points.size() + BLOCK - 1) / BLOCK;
+  vector<size_t> changed(blocks, 0);
+  parallel::parallelFor(blocks, threads, [&](size_t b) {
+    size_t to = min(points.size(), (b + 1) * BLOCK);
+    for (size_t i = b * BLOCK; i < to; i++)
+    {
+      centroidPoint p = { { (float) points[i].r, (float) points[i].g, (float) points[i].b }, -1 };
+      int c = tree.findNearestNeighbor(p).id;
+      if (c != assignment[i]) { changed[b]++; assignment[i] = c; }
+    }
+  });
+  size_t total = 0;
+  for (size_t c : changed) { total += c; }
+  return total;
+}
+
+void ivfindex::build(const vector<RGBAPixel> & input, int clusters)
+{
+  for (int c = 0; c < 3; c++) { centroid[c].clear(); channels[c].clear(); }
+  radius.clear();
+  keys.clear();
+  clusterStart.assign(1, 0);
+  if (input.empty()) { return; }
+
+  if (clusters < 0)
+  {
+    cerr << "WARNING: ivfindex cluster count must not be negative, not " << clusters
+         << "; choosing one" << endl;
+    clusters = 0;
+  }
+  if (clusters == 0) { clusters = max(1, (int) sqrt((double) input.size())); }
+  clusters = (int) min((size_t) clusters, input.size());
+
+  //training sample
+  vector<RGBAPixel> sample;
+  size_t n = min(input.size(), TRAINING);
+  sample.reserve(n);
+  for (size_t i = 0; i < n; i++) { sample.push_back(input[i * input.size() / n]); }
+
+  //seeds: evenly spaced along the sample in Z order, which puts more of them
+  //where the keys are dense; repeated colors are dropped
+  vector<pair<uint32_t, uint32_t> > order(n);
+  for (size_t i = 0; i < n; i++) { order[i] = make_pair(mortonCode(sample[i]), (uint32_t) i); }
+  sort(order.begin(), order.end());
+  vector<centroidPoint> centroids;
+  uint32_t last = UINT32_MAX;
+  for (int c = 0; c < clusters; c++)
+  {
+    const pair<uint32_t, uint32_t> & seed = order[(2 * (size_t) c + 1) * n / (2 * clusters)];
+    if (seed.first == last) { continue; }
+    last = seed.first;
+    const RGBAPixel & p = sample[seed.second];
+    centroidPoint point = { { (float) p.r, (float) p.g, (float) p.b }, (int) centroids.size() };
+    centroids.push_back(point);
+  }
+
+  //Lloyd iterations on the sample. The sums are exact integers, so the
+  //centroids don't depend on the order the threads finished in; an empty
+  //cluster keeps its centroid
+  vector<int> assignment(n, -1);
+  for (int iteration = 0; iteration < ITERATIONS; iteration++)
+  {
+    if (assign(sample, centroids, assignment, threads) == 0) { break; }
+    vector<int64_t> sums(centroids.size() * 4, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+      int64_t * s = &sums[assignment[i] * 4];
+      s[0] += sample[i].r;
+      s[1] += sample[i].g;
+      s[2] += sample[i].b;
+      s[3]++;
+    }
+    for (size_t c = 0; c < centroids.size(); c++)
+    {
+      int64_t * s = &sums[c * 4];
+      if (s[3] == 0) { continue; }
+      for (int a = 0; a < 3; a++) { centroids[c].c[a] = (float) ((double) s[a] / s[3]); }
+    }
+  }
+
+  //every key to its cluster, then a counting sort by cluster that drops the
+  //empty ones
+  vector<int> cluster(input.size(), -1);
+  assign(input, centroids, cluster, threads);
+  vector<int> count(centroids.size(), 0);
+  for (int c : cluster) { count[c]++; }
+  vector<int> renumber(centroids.size(), -1);
+  for (size_t c = 0; c < centroids.size(); c++)
+  {
+    if (count[c] == 0) { continue; }
+    renumber[c] = (int) radius.size();
+    clusterStart.push_back(clusterStart.back() + count[c]);
+    for (int a = 0; a < 3; a++) { centroid[a].push_back(centroids[c].c[a]); }
+    radius.push_back(0);
+  }
+
+  vector<int> next(clusterStart.begin(), clusterStart.end() - 1);
+  keys.resize(input.size());
+  for (size_t i = 0; i < input.size(); i++)
+  {
+    int c = renumber[cluster[i]];
+    keys[next[c]++] = input[i];
+  }
+
+  //padded by a chunk, so scans can always read whole chunks
+  for (int a = 0; a < 3; a++) { channels[a].assign(keys.size() + CHUNK, 0); }
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    channels[0][i] = keys[i].r;
+    channels[1][i] = keys[i].g;
+    channels[2][i] = keys[i].b;
+  }
+
+  //radii, rounded up a little so float error can never prune a cluster
+  //that holds the answer
+  for (int c = 0; c < clusterCount(); c++)
+  {
+    double far = 0;
+    for (int i = clusterStart[c]; i < clusterStart[c + 1]; i++)
+    {
+      double dr = keys[i].r - centroid[0][c], dg = keys[i].g - centroid[1][c], db = keys[i].b - centroid[2][c];
+      far = max(far, dr * dr + dg * dg + db * db);
+    }
+    radius[c] = (float) (sqrt(far) * 1.0001 + 0.01);
+  }
+
+  //centroids padded to whole chunks too, far outside the cube (but not so far
+  //that squared distances overflow an int), and the largest radius per chunk
+  size_t chunks = (radius.size() + CHUNK - 1) / CHUNK;
+  for (int a = 0; a < 3; a++) { centroid[a].resize(chunks * CHUNK, 4096); }
+  chunkRadius.assign(chunks, 0);
+  for (int c = 0; c < clusterCount(); c++) { chunkRadius[c / CHUNK] = max(chunkRadius[c / CHUNK], radius[c]); }
+}
+
+//////////////////////////////////////
+
+////////////////////////////////////// NEAREST NEIGHBOR + HELPERS
+
+/**
+ * All distances of a chunk first, with their minimum, in branch-free loops
+ * over the channel arrays the compiler can vectorize; only a chunk that can
+ * improve on best is searched for where. The distances are computed in
+ * float, exactly (they are integers below 2^24).
+ */
+void ivfindex::scanCluster(int cluster, const RGBAPixel & query, int & best, int & bestIndex) const
+{
+  int distances[CHUNK];
+  float qr = query.r, qg = query.g, qb = query.b;
+
+  for (int base = clusterStart[cluster]; base < clusterStart[cluster + 1]; base += CHUNK)
+  {
+    int count = min(CHUNK, clusterStart[cluster + 1] - base);
+    const unsigned char * r = &channels[0][base];
+    const unsigned char * g = &channels[1][base];
+    const unsigned char * b = &channels[2][base];
+    for (int j = 0; j < CHUNK; j++)
+    {
+      float dr = qr - r[j], dg = qg - g[j], db = qb - b[j];
+      distances[j] = (int) (dr * dr + dg * dg + db * db);
+    }
+    for (int j = count; j < CHUNK; j++) { distances[j] = INT_MAX; }
+    int nearest = INT_MAX;
+    for (int j = 0; j < CHUNK; j++) { nearest = min(nearest, distances[j]); }
+    if (nearest > best) { continue; }
+
+    for (int j = 0; j < count; j++)
+    {
+      if (distances[j] < best ||
+          (distances[j] == best && keys[base + j].rgb() < keys[bestIndex].rgb()))
+      {
+        best = distances[j];
+        bestIndex = base + j;
+      }
+    }
+  }
+}
+
+RGBAPixel ivfindex::findNearestNeighbor(const RGBAPixel & query) const
+{
+  return findNearestNeighbor(query, probes, NULL);
+}
+
+RGBAPixel ivfindex::findNearestNeighbor(const RGBAPixel & query, int probes, long * scanned) const
+{
+  vector<int> distances;
+  return search(query, probes, distances, scanned);
+}
+
+/**
+ * Squared distances to the centroids go in distances, a chunk at a time in
+ * loops the compiler can vectorize, followed by each chunk's minimum; then
+ * the choice of clusters passes over whole chunks that can't matter. The
+ * distances are truncated to ints, which only ever understates them, so the
+ * exact search's bounds stay safe. (Float arithmetic, converted, vectorizes
+ * better on plain SSE2 than 32-bit integer multiplies.)
+ */
+RGBAPixel ivfindex::search(const RGBAPixel & query, int probes, vector<int> & distances,
+                           long * scanned) const
+{
+  int k = clusterCount();
+  if (k == 0) { return RGBAPixel(); }
+
+  int chunks = (int) chunkRadius.size();
+  distances.resize(chunks * (CHUNK + 1));
+  int * d = distances.data();
+  int * low = d + chunks * CHUNK;
+  float qr = query.r, qg = query.g, qb = query.b;
+  for (int chunk = 0; chunk < chunks; chunk++)
+  {
+    const float * cr = &centroid[0][chunk * CHUNK];
+    const float * cg = &centroid[1][chunk * CHUNK];
+    const float * cb = &centroid[2][chunk * CHUNK];
+    int local[CHUNK];
+    for (int j = 0; j < CHUNK; j++)
+    {
+      float dr = qr - cr[j], dg = qg - cg[j], db = qb - cb[j];
+      local[j] = (int) (dr * dr + dg * dg + db * db);
+    }
+    int nearest = INT_MAX;
+    for (int j = 0; j < CHUNK; j++) { nearest = min(nearest, local[j]); }
+    for (int j = 0; j < CHUNK; j++) { d[chunk * CHUNK + j] = local[j]; }
+    low[chunk] = nearest;
+  }
+
+  int best = INT_MAX;
+  int bestIndex = -1;
+  long keysScanned = 0;
+
+  if (probes > 0 && probes < k)
+  {
+    //the probes nearest centroids, kept sorted by insertion; ties to the
+    //lower cluster number
+    vector<int> nearest;
+    nearest.reserve(probes + 1);
+    int worst = INT_MAX;   // what a cluster must beat to be kept
+    for (int chunk = 0; chunk < chunks; chunk++)
+    {
+      if (low[chunk] >= worst) { continue; }
+      for (int c = chunk * CHUNK; c < min(k, (chunk + 1) * CHUNK); c++)
+      {
+        if (d[c] >= worst) { continue; }
+        size_t at = nearest.size();
+        while (at > 0 && d[nearest[at - 1]] > d[c]) { at--; }
+        nearest.insert(nearest.begin() + at, c);
+        if ((int) nearest.size() > probes) { nearest.pop_back(); }
+        if ((int) nearest.size() == probes) { worst = d[nearest.back()]; }
+      }
+    }
+    for (int c : nearest)
+    {
+      scanCluster(c, query, best, bestIndex);
+      keysScanned += clusterStart[c + 1] - clusterStart[c];
+    }
+  }
+  else
+  {
+    //exact: the nearest centroid's cluster first, for a tight bound, then
+    //every cluster whose sphere reaches within it. Equal distance still
+    //counts: a tie there may have the smaller color
+    int firstChunk = (int) (min_element(low, low + chunks) - low);
+    int first = (int) (find(d + firstChunk * CHUNK, d + (firstChunk + 1) * CHUNK, low[firstChunk]) - d);
+    scanCluster(first, query, best, bestIndex);
+    keysScanned += clusterStart[first + 1] - clusterStart[first];
+
+    //the sphere of c reaches within best when |q - centroid| <= sqrt(best) + radius
+    float root = sqrt((float) best);
+    for (int chunk = 0; chunk < chunks; chunk++)
+    {
+      float reach = root + chunkRadius[chunk];
+      if (low[chunk] > reach * reach) { continue; }
+      for (int c = chunk * CHUNK; c < min(k, (chunk + 1) * CHUNK); c++)
+      {
+        reach = root + radius[c];
+        if (c == first || d[c] > reach * reach) { continue; }
+        scanCluster(c, query, best, bestIndex);
+        keysScanned += clusterStart[c + 1] - clusterStart[c];
+        root = sqrt((float) best);
+      }
+    }
+  }
+
+  if (scanned != NULL) { *scanned += keysScanned; }
+  return keys[bestIndex];
+}
+
+void ivfindex::findNearestNeighbors(const vector<RGBAPixel> & queries, vector<RGBAPixel> & results) const
+{
+  results.resize(queries.size());
+  size_t blocks = (queries.size() + BLOCK - 1) / BLOCK;
+  parallel::parallelFor(blocks, threads, [&](size_t b) {
+    vector<int> distances;
+    size_t to = min(queries.size(), (b + 1) * BLOCK);
+    for (size_t i = b * BLOCK; i < to; i++) { results[i] = search(queries[i], probes, distances, NULL); }
+  });
+}
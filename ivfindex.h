@@ -0,0 +1,103 @@
+/**
+ *
+ * ivfindex: two-level clustered (inverted file) matching for large libraries
+ *
+ */
+
+#ifndef _IVFINDEX_H_
+#define _IVFINDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "cs221util/RGBAPixel.h"
+#include "nnindex.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * sRGB matching engine for million-tile libraries. k-means splits the keys
+ * into coarse clusters, and each cluster's keys are stored contiguously,
+ * channels in separate arrays. A query measures its distance to every
+ * centroid in one vectorized pass, then scans whole clusters -- sequential
+ * runs of memory instead of a tree walk that misses cache at every level.
+ *
+ * probes is the speed/recall knob: a positive value scans only that many
+ * nearest clusters, so the answer can miss a closer key just over a cluster
+ * boundary; 0 is exact, scanning every cluster that its bounding sphere
+ * (centroid and radius) can't rule out. Exact answers settle ties by the
+ * smaller packed color (r, then g, then b), like gridindex.
+ *
+ * The build is deterministic: the seeds are spread evenly along a Z-order
+ * curve through the keys, the assignment runs in parallel, and the centroid
+ * sums are exact integers, so any thread count gives the same clusters.
+ */
+class ivfindex : public nnindex {
+
+public:
+
+    /**
+     * Clusters the keys of photos.
+     *
+     * @param clusters number of clusters; 0 picks about sqrt(keys).
+     * @param probes clusters findNearestNeighbor scans; 0 means exact.
+     * @param threads workers for the assignment passes; 0 means all.
+     */
+    ivfindex(const map<RGBAPixel, string> & photos, int clusters = 0, int probes = 0,
+             unsigned threads = 0);
+
+    /**
+     * Clusters the given keys, for callers without a photos map.
+     */
+    ivfindex(const vector<RGBAPixel> & keys, int clusters = 0, int probes = 0,
+             unsigned threads = 0);
+
+    /** Searches with the probes given to the constructor. */
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query) const;
+
+    /**
+     * @param probes clusters to scan, nearest centroids first; 0 means exact.
+     * @param scanned if not NULL, incremented by the keys compared.
+     */
+    RGBAPixel findNearestNeighbor(const RGBAPixel & query, int probes, long * scanned = NULL) const;
+
+    /**
+     * Batch form, spread over threads, with the constructor's probes.
+     */
+    void findNearestNeighbors(const vector<RGBAPixel> & queries,
+                              vector<RGBAPixel> & results) const;
+
+    /** Number of clusters. */
+    int clusterCount() const { return (int) radius.size(); }
+
+    /** Number of keys. */
+    int size() const { return (int) keys.size(); }
+
+private:
+
+    int probes;
+    unsigned threads;
+
+    /* cluster c holds keys [clusterStart[c], clusterStart[c+1]) */
+    vector<int> clusterStart;
+    vector<RGBAPixel> keys;
+    vector<unsigned char> channels[3];   // padded by a chunk
+
+    /* centroid coordinates, one array per channel padded to whole chunks;
+     * the largest distance (not squared) from each centroid to a key of its
+     * cluster, rounded up; and the largest radius in each chunk */
+    vector<float> centroid[3];
+    vector<float> radius;
+    vector<float> chunkRadius;
+
+    void build(const vector<RGBAPixel> & input, int clusters);
+
+    /* the search, with distances a buffer it can reuse across queries */
+    RGBAPixel search(const RGBAPixel & query, int probes, vector<int> & distances,
+                     long * scanned) const;
+
+    /* brute force over one cluster, best and bestIndex updated in place */
+    void scanCluster(int cluster, const RGBAPixel & query, int & best, int & bestIndex) const;
+};
+
+#endif
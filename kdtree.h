@@ -0,0 +1,192 @@
+/**
+ *
+ * kdtree: K-dimensional tree template shared by the color spaces
+ *
+ */
+
+#ifndef _KDTREE_H_
+#define _KDTREE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+using namespace std;
+
+/**
+ * kdpoint: a point with K coordinates of type T plus an integer payload
+ * (usually the index of the library tile the point describes). Coordinates
+ * are a plain array, so coordinate d of a point is p[d] for every d -- no
+ * switch over named fields.
+ */
+template <class T, int K>
+struct kdpoint {
+    T c[K];
+    int id;
+
+    T operator[](int d) const { return c[d]; }
+};
+
+/**
+ * squaredL2: squared Euclidean distance, accumulated in T (int for 8-bit
+ * channels, float for Lab and the HSL cone). A kdtree metric provides
+ *   distance<K>(a, b): the distance between two points, and
+ *   axis(diff):        the distance contributed by a difference of diff in a
+ *                      single coordinate, used to decide whether the far side
+ *                      of a splitting plane can hold a closer point.
+ * Pruning is only exact for metrics that are sums of per-coordinate terms
+ * (like squared Euclidean or Manhattan distance).
+ */
+template <class T>
+struct squaredL2 {
+    typedef T value_type;
+
+    template <int K, class Point>
+    static T distance(const Point & a, const Point & b)
+    {
+        T sum = 0;
+        for (int d = 0; d < K; d++) {
+            T diff = (T) a[d] - (T) b[d];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    static T axis(T diff) { return diff * diff; }
+};
+
+/**
+ * kdtree<Point, K, Metric>: rgbtree's kd tree with the dimension
+ * and metric fixed at compile time. Point is any type with a
+ * `operator[](int d)` returning coordinate d for d in [0, K) and an int `id`
+ * payload (kdpoint is the usual choice).
+ *
+ * Layout: the same implicit array as rgbtree -- the node for the range
+ * [start, end] of the array is at (start+end)/2 and its subtrees are the
+ * halves on either side -- so no child pointers are stored.
+ *
+ * Splitting: each node splits on the coordinate with the widest spread over
+ * its subtree, and that coordinate is stored per node. In high dimensions
+ * most coordinates are nearly constant over a small subtree, and cycling
+ * through them by level would waste levels on splits that prune nothing.
+ * With K known at compile time the distance loop is fully unrolled and the
+ * per-node work is one indexed load and compare, whatever K is.
+ */
+template <class Point, int K, class Metric = squaredL2<int> >
+class kdtree {
+
+public:
+
+    typedef typename Metric::value_type distance_type;
+
+    kdtree() {}
+
+    /**
+     * Builds the tree over a copy of points.
+     */
+    kdtree(const vector<Point> & points)
+      : tree(points), splitDim(points.size(), 0)
+    {
+        buildTree(0, size() - 1);
+    }
+
+    /**
+     * Finds the point closest to query under Metric.
+     *
+     * @param query the point to search for.
+     * @param visited if not NULL, incremented by the number of nodes examined.
+     * @return the position in points() of the nearest point, or -1 if the tree
+     *  is empty. Among points at equal distance the first one reached wins.
+     */
+    int findNearestIndex(const Point & query, long * visited = NULL) const
+    {
+        int best = -1;
+        distance_type bestDistance = numeric_limits<distance_type>::max();
+        long count = 0;
+
+        fNN_recursive(query, 0, size() - 1, best, bestDistance, count);
+
+        if (visited != NULL) { *visited += count; }
+        return best;
+    }
+
+    /**
+     * Finds the point closest to query. The tree must not be empty.
+     */
+    const Point & findNearestNeighbor(const Point & query, long * visited = NULL) const
+    {
+        return tree[findNearestIndex(query, visited)];
+    }
+
+    /** The points, in tree order. */
+    const vector<Point> & points() const { return tree; }
+
+    int size() const { return (int) tree.size(); }
+
+private:
+
+    vector<Point> tree;              // points in implicit tree order
+    vector<unsigned char> splitDim;  // splitting coordinate per node
+
+    void buildTree(int start, int end)
+    {
+        if (start > end) { return; }
+
+        int median = (start + end) / 2;
+
+        int best = 0;
+        distance_type bestSpread = -1;
+        for (int d = 0; d < K; d++) {
+            distance_type lo = tree[start][d], hi = tree[start][d];
+            for (int i = start + 1; i <= end; i++) {
+                lo = min<distance_type>(lo, tree[i][d]);
+                hi = max<distance_type>(hi, tree[i][d]);
+            }
+            if (hi - lo > bestSpread) {
+                bestSpread = hi - lo;
+                best = d;
+            }
+        }
+        splitDim[median] = best;
+
+        // ties on the coordinate are broken by the payload so the build is
+        // deterministic for any input order
+        nth_element(tree.begin() + start, tree.begin() + median, tree.begin() + end + 1,
+                    [best](const Point & a, const Point & b) {
+                        return a[best] < b[best] || (a[best] == b[best] && a.id < b.id);
+                    });
+
+        buildTree(start, median - 1);
+        buildTree(median + 1, end);
+    }
+
+    void fNN_recursive(const Point & query, int start, int end, int & best,
+                       distance_type & bestDistance, long & visited) const
+    {
+        if (start > end) { return; }
+
+        int median = (start + end) / 2;
+        const Point & node = tree[median];
+        visited++;
+
+        distance_type d = Metric::template distance<K>(query, node);
+        if (d < bestDistance) {
+            best = median;
+            bestDistance = d;
+        }
+
+        // near side first, far side only if the splitting plane is closer
+        // than the best distance so far
+        int dim = splitDim[median];
+        distance_type diff = (distance_type) query[dim] - (distance_type) node[dim];
+        bool left = diff < 0;
+        fNN_recursive(query, left ? start : median + 1, left ? median - 1 : end,
+                      best, bestDistance, visited);
+        if (Metric::axis(diff) < bestDistance) {
+            fNN_recursive(query, left ? median + 1 : start, left ? end : median - 1,
+                          best, bestDistance, visited);
+        }
+    }
+};
+
+#endif
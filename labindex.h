@@ -0,0 +1,32 @@
+/**
+ *
+ * labindex: nearest neighbor matching in CIELAB
+ *
+ */
+
+#ifndef _LABINDEX_H_
+#define _LABINDEX_H_
+
+#include "colorspace.h"
+#include "colorindex.h"
+
+/**
+ * sRGB to CIELAB, as a colorindex conversion.
+ */
+struct labConversion {
+    typedef colorspace::labPoint point_type;
+
+    static point_type convert(const RGBAPixel & pixel) { return colorspace::rgbToLab(pixel); }
+    static void convert(const RGBAPixel * pixels, size_t n, point_type * out)
+    {
+        colorspace::rgbToLab(pixels, n, out);
+    }
+};
+
+/**
+ * Perceptual matching engine: squared Euclidean distance in CIELAB is CIE76
+ * delta E.
+ */
+typedef colorindex<labConversion> labindex;
+
+#endif
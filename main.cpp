@@ -5,40 +5,178 @@
 
 
 #include "rgbtree.h"
+#include "labindex.h"
+#include "coneindex.h"
+#include "approxindex.h"
+#include "gridindex.h"
+#include "ivfindex.h"
+#include "de2000index.h"
+#include "grayindex.h"
 #include "cs221util/PNG.h"
 #include "cs221util/RGBAPixel.h"
 #include "tileUtil.h"
 #include <iostream>
 #include <map>
-
-#define TILESIZE 30
+#include <memory>
+#include <cstdlib>
 
 using namespace std;
 using namespace cs221util;
 using namespace tiler;
 
 
-int main()
+static int usage(const char * name)
 {
+    cerr << "usage: " << name << " [-s tileSize] [-i originalsDir] [-g grid] [-m rgb|lab|hsl|de2000] [-x tree|grid|ivf] [-e epsilon] [-v]"
+         << " [target.png [mosaic.png]]" << endl;
+    return 1;
+}
+
+int main(int argc, char * argv[])
+{
+    // -s: the tile size must match the thumbnails in the library; buildMap
+    //     skips any file of a different size.
+    // -i: given a directory of full-size originals, the library is first
+    //     rebuilt from them into tilestore/ at that size.
+    // -g: match grid x grid sub-block descriptors (2 or 3) instead of single
+    //     average colors; each grid x grid block of the target becomes a tile.
+    // -m: color space the average colors are matched in: rgb (default), lab,
+    //     hsl (HSLAPixel's cone distance), or de2000 (CIEDE2000 in Lab).
+    // -x: the structure exact rgb matching searches: tree (rgbtree, default)
+    //     grid (a uniform grid over the RGB cube), or ivf (k-means clusters
+    //     scanned exhaustively, for libraries of a million tiles and more).
+    // -e: rgb matching may pick a tile up to (1+epsilon) times farther than the
+    //     best one, which searches fewer nodes -- for quick previews.
+    // -v: report the target's pixel and distinct color counts and the search
+    //     time on stdout (not with -g, which has no per-color search).
+    unsigned tileSize = TILESIZE;
+    unsigned grid = 1;
+    string originals;
+    string matching = "rgb";
+    string structure = "tree";
+    double epsilon = 0;
+    bool verbose = false;
+    string targetFile = "targets/pyang25.png";
+    string mosaicFile = "targets/mosaic.png";
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-v") { verbose = true; continue; }
+        if ((arg == "-s" || arg == "-g" || arg == "-i" || arg == "-m" || arg == "-x" || arg == "-e") && i + 1 < argc) {
+            string value = argv[++i];
+            if (arg == "-i") { originals = value; continue; }
+            if (arg == "-e") {
+                epsilon = atof(value.c_str());
+                if (epsilon < 0) { return usage(argv[0]); }
+                continue;
+            }
+            if (arg == "-x") {
+                if (value != "tree" && value != "grid" && value != "ivf") { return usage(argv[0]); }
+                structure = value;
+                continue;
+            }
+            if (arg == "-m") {
+                if (value != "rgb" && value != "lab" && value != "hsl" && value != "de2000") { return usage(argv[0]); }
+                matching = value;
+                continue;
+            }
+            int n = atoi(value.c_str());
+            if (n <= 0) { return usage(argv[0]); }
+            // blocktree handles 3-, 12- and 27-D descriptors only
+            if (arg == "-g" && n > 3) { return usage(argv[0]); }
+            if (arg == "-s") { tileSize = n; } else { grid = n; }
+        } else if (!arg.empty() && arg[0] != '-' && positional < 2) {
+            (positional++ == 0 ? targetFile : mosaicFile) = arg;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    // the engines are picked by -g, then -m, then -e, then -x: refuse the
+    // flags a combination would otherwise silently ignore
+    if (epsilon > 0 && matching != "rgb") {
+        cerr << "-e applies only to rgb matching, not -m " << matching << endl;
+        return usage(argv[0]);
+    }
+    if (structure != "tree" && (matching != "rgb" || epsilon > 0)) {
+        cerr << "-x " << structure << " applies only to exact rgb matching" << endl;
+        return usage(argv[0]);
+    }
+    if (grid > 1 && (matching != "rgb" || epsilon > 0 || structure != "tree")) {
+        cerr << "-g matches sub-block descriptors in rgb; -m, -e and -x don't apply" << endl;
+        return usage(argv[0]);
+    }
+    if (grid > 1 && verbose) {
+        cerr << "-v reports single-color searches; -g tiles by blocks and has none" << endl;
+        return usage(argv[0]);
+    }
+
+    string library = "imlib/";
+    map<RGBAPixel, string> photos;
+    if (!originals.empty()) {
+        // resample the originals and collect their averages in one pass; the
+        // map is the one buildMap would read back from tilestore/
+        library = "tilestore/";
+        photos = ingestLibrary(originals, library, tileSize);
+    }
+
+    // read a (small, 100x150 or so) target image into timage, or keep a palette
+    // target indexed when matching single colors
+    indexedImage itarget;
+    bool indexed = grid == 1 && readIndexedPNG(targetFile, itarget);
+    PNG timage;
+    if (!indexed) { timage.readFromFile(targetFile); }
+
+    if (grid > 1) {
+        blockLibrary blocks = buildBlockLibrary(library, grid, tileSize);
+        if (blocks.files.empty()) {
+            cerr << "no " << tileSize << "x" << tileSize << " thumbnails found in " << library << endl;
+            return 1;
+        }
+        blocktree searchStructure(blocks.descriptors, 3 * grid * grid);
+        PNG mosaic = tileBlocks(timage, searchStructure, blocks, grid, tileSize);
+        mosaic.writeToFile(mosaicFile);
+        return 0;
+    }
 
     // read directory and create map of average color -> file name (this function is given)
-    map<RGBAPixel, string> photos = buildMap("imlib/");
+    if (originals.empty()) { photos = buildMap(library, tileSize); }
+    if (photos.empty()) {
+        cerr << "no " << tileSize << "x" << tileSize << " thumbnails found in " << library << endl;
+        return 1;
+    }
     
     // build the kd tree given the photos map.  (you'll implement a rgbtree)
-    rgbtree searchStructure(photos);
+    // in lab mode the same keys are matched perceptually instead, and a
+    // grayscale library needs only a lookup table
+    unique_ptr<nnindex> searchStructure;
+    if (matching == "lab") { searchStructure.reset(new labindex(photos)); }
+    else if (matching == "hsl") { searchStructure.reset(new coneindex(photos)); }
+    else if (matching == "de2000") { searchStructure.reset(new de2000index(photos)); }
+    else if (epsilon > 0) { searchStructure.reset(new approxindex(photos, epsilon)); }
+    else if (structure == "grid") { searchStructure.reset(new gridindex(photos)); }
+    else if (structure == "ivf") { searchStructure.reset(new ivfindex(photos)); }
+    else if (grayindex::accepts(photos)) { searchStructure.reset(new grayindex(photos)); }
+    else { searchStructure.reset(new rgbtree(photos)); }
 
-    // read a (small, 100x150 or so) target image into timage
-    // tile(timage) returns a TILESIZExwidth by TILESIZExheight image corresponding
+    // tile(timage) returns a tileSizexwidth by tileSizexheight image corresponding
     // to the target.
-    PNG timage; timage.readFromFile("targets/pyang25.png");
 
     // functionality of tile: for each pixel in the target image, find pixel's NN
     // in the kdtree, returning a photoID. Use the photoID to open the 
     // correct file, and use that file's pixels in the appropriate place
     // in the return image. You'll implement this function in __________________
-    PNG mosaic = tile(timage, searchStructure, photos);
+    // palette targets are tiled from their index plane, searching only the palette
+    tileStats stats;
+    PNG mosaic = indexed ? tileIndexed(itarget, *searchStructure, photos, tileSize, &stats)
+                         : tile(timage, *searchStructure, photos, tileSize, &stats);
+    if (verbose) {
+        cout << stats.pixels << " pixels, " << stats.distinct << " distinct colors ("
+             << stats.dedupRatio() << "x dedup), search " << stats.searchSeconds * 1000 << " ms" << endl;
+    }
 
-    mosaic.writeToFile("targets/mosaic.png");
+    mosaic.writeToFile(mosaicFile);
 
   return 0;
 }
@@ -0,0 +1,50 @@
+/**
+ *
+ * nnindex: the query interface shared by the color matching engines
+ *
+ */
+
+#ifndef _NNINDEX_H_
+#define _NNINDEX_H_
+
+#include <vector>
+#include "cs221util/RGBAPixel.h"
+using namespace std;
+using namespace cs221util;
+
+/**
+ * What tile() needs from a search structure: given a target color, the key
+ * (average color) of the library tile to use for it. rgbtree answers in raw
+ * sRGB; other engines may convert the query into another color space or use a
+ * different structure, but every answer is a key of the photos map the
+ * engine was built from. Queries are const and may run concurrently on one
+ * engine, as tile() does.
+ */
+class nnindex {
+
+public:
+
+    virtual ~nnindex() {}
+
+    /**
+     * @param query a target color.
+     * @return the key of the library tile that best matches query.
+     */
+    virtual RGBAPixel findNearestNeighbor(const RGBAPixel & query) const = 0;
+
+    /**
+     * Batch form: results[i] is the answer for queries[i]. The default loops
+     * over findNearestNeighbor; engines override it when they can amortize
+     * work (color conversion, traversal) over a whole image.
+     */
+    virtual void findNearestNeighbors(const vector<RGBAPixel> & queries,
+                                      vector<RGBAPixel> & results) const
+    {
+        results.resize(queries.size());
+        for (size_t i = 0; i < queries.size(); i++) {
+            results[i] = findNearestNeighbor(queries[i]);
+        }
+    }
+};
+
+#endif
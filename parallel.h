@@ -0,0 +1,78 @@
+/**
+ * @file parallel.h
+ * Minimal fork/join helpers shared by the ingest, build and query paths.
+ */
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+/**
+ * Number of worker threads to use when the caller passes 0 ("pick for me").
+ * Falls back to 1 when the platform can't tell us.
+ */
+inline unsigned defaultThreads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+/**
+ * Whether the calling thread is a worker of a parallelFor that runs on more
+ * than one thread.
+ */
+inline bool & insideParallelFor()
+{
+    static thread_local bool inside = false;
+    return inside;
+}
+
+/**
+ * Calls fn(i) for every i in [0, n), spread over `threads` workers that pull
+ * indices from a shared counter, so uneven work items (big and small files,
+ * deep and shallow subtrees) balance themselves. The calling thread is one of
+ * the workers. fn must be safe to call concurrently for distinct i.
+ *
+ * Only the outermost level is parallel: called from a worker of another
+ * parallelFor (tile()'s batches calling an engine's parallel batch search,
+ * say), it runs serially on that worker, so nesting never starts more
+ * threads than the outer call did.
+ *
+ * @param n number of work items.
+ * @param threads worker count; 0 means defaultThreads().
+ * @param fn callable taking a size_t index.
+ */
+template <class F>
+void parallelFor(std::size_t n, unsigned threads, F fn)
+{
+    if (threads == 0) { threads = defaultThreads(); }
+    threads = (unsigned) std::min<std::size_t>(threads, n);
+
+    if (threads <= 1 || insideParallelFor()) {
+        for (std::size_t i = 0; i < n; i++) { fn(i); }
+        return;
+    }
+
+    std::atomic<std::size_t> next(0);
+    auto worker = [&]() {
+        insideParallelFor() = true;
+        for (std::size_t i = next++; i < n; i = next++) { fn(i); }
+        insideParallelFor() = false;
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) { pool.emplace_back(worker); }
+    worker();
+    for (auto & th : pool) { th.join(); }
+}
+
+}
+
+#endif
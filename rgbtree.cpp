@@ -5,9 +5,12 @@
 
 #include <utility>
 #include <algorithm>
+#include <bitset>
+#include <cstdint>
 #include "rgbtree.h"
 
 #include <limits.h>
+#include "parallel.h"
 
 using namespace std;
 
@@ -22,7 +25,13 @@ using namespace std;
 
 ////////////////////////////////////// CONSTRUCTOR
 
-rgbtree::rgbtree(const map<RGBAPixel,string>& photos)
+// ranges smaller than this are partitioned by one thread; below it the
+// fork/join overhead outweighs the scan
+static const int PARALLEL_CUTOFF = 1 << 16;
+
+rgbtree::rgbtree(const map<RGBAPixel,string>& photos, unsigned threads, medianMethod method,
+                 int leafSize)
+  : method(method), leafSize(min(max(leafSize, 1), MAX_LEAF))
 {
   //build the vector "tree" of RGBAPixels from the keys in map "photos"
   for (auto const& x : photos)
@@ -30,23 +39,50 @@ rgbtree::rgbtree(const map<RGBAPixel,string>& photos)
     tree.push_back(x.first);
   }
 
+  build(threads);
+}
+
+rgbtree::rgbtree(const vector<RGBAPixel>& keys, unsigned threads, medianMethod method,
+                 int leafSize)
+  : tree(keys), method(method), leafSize(min(max(leafSize, 1), MAX_LEAF))
+{
+  build(threads);
+}
+
+void rgbtree::build(unsigned threads)
+{
   //setup
   int initial_start = 0;
   int initial_end = tree.size()-1;
   int initial_dimension = 0;
   int initial_median = (initial_start+initial_end)/2;
 
-  buildTree(initial_start, initial_end, initial_median, initial_dimension);
+  removedCount = 0;
+
+  if (threads == 0) { threads = parallel::defaultThreads(); }
+  scratch.resize(tree.size());
+  buildTreeParallel(initial_start, initial_end, initial_median, initial_dimension, threads);
+  vector<RGBAPixel>().swap(scratch);
+
+  if (leafSize > 1)
+  {
+    for (int c = 0; c < 3; c++)
+    {
+      leaves[c].resize(tree.size());
+      for (size_t i = 0; i < tree.size(); i++) { leaves[c][i] = channel(tree[i], c); }
+    }
+  }
 }
 
 void rgbtree::buildTree(int start, int end, int median, int dimension)
 {
-  //base case: single elements will be in order vacuosuly
-  if (start >= end)
+  //base case: single elements will be in order vacuosuly (and buckets
+  //are left unordered)
+  if (end - start + 1 <= leafSize)
   { return; }
 
-  //quickSelect will put the median element into place
-  quickSelect(start, end, median, dimension);
+  //quickSelect (or the histogram select) will put the median element into place
+  selectMedian(start, end, median, dimension, 1);
 
   //tick to next dimension
   dimension++;
@@ -61,6 +97,34 @@ void rgbtree::buildTree(int start, int end, int median, int dimension)
   buildTree(median+1, end, rightSubTree_Median, nextDimension);
 }
 
+void rgbtree::buildTreeParallel(int start, int end, int median, int dimension, unsigned threads)
+{
+  struct range { int start, end, median, dimension; };
+  vector<range> level(1, range{start, end, median, dimension});
+
+  //split level by level while there are fewer subtrees than workers to keep
+  //busy; every split of a big range is itself done by all threads
+  while (threads > 1 && level.size() < 4 * threads)
+  {
+    vector<range> next;
+    for (const range & r : level)
+    {
+      if (r.end - r.start + 1 <= leafSize) { continue; }
+      selectMedian(r.start, r.end, r.median, r.dimension, threads);
+      int nextDimension = (r.dimension + 1) % 3;
+      next.push_back(range{r.start, r.median-1, (r.start + (r.median-1))/2, nextDimension});
+      next.push_back(range{r.median+1, r.end, ((r.median+1) + r.end)/2, nextDimension});
+    }
+    if (next.empty()) { return; }
+    level.swap(next);
+  }
+
+  //the rest are disjoint ranges of the array: build them as separate tasks
+  parallel::parallelFor(level.size(), threads, [&](size_t i) {
+    buildTree(level[i].start, level[i].end, level[i].median, level[i].dimension);
+  });
+}
+
 //////////////////////////////////////
 
 ////////////////////////////////////// NEAREST NEIGHBOR + HELPERS
@@ -71,6 +135,17 @@ RGBAPixel rgbtree::findNearestNeighbor(const RGBAPixel & query) const
   int end = tree.size()-1;
   int index_rootMin = (start+end)/2;
   int dimension = 0;
+  //with tombstones the root may be gone, and no other key can stand in for
+  //it without jumping the order ties are settled in: search by index instead
+  if (removedCount > 0) { return findApproximateNeighbor(query, 0); }
+  if (index_rootMin >= (int) tree.size()) { return RGBAPixel(); }
+  //a tree that is one bucket has no root node: seeding with its middle key
+  //would let that key win ties that belong to the earlier keys
+  if (leafSize > 1 && end - start + 1 <= leafSize)
+  {
+    RGBAPixel none;
+    return scanLeaf(query, start, end, none, INT_MAX);
+  }
   RGBAPixel rootMin = tree[index_rootMin];
 
   int bestDistance = distance3D(query, rootMin);
@@ -80,10 +155,388 @@ RGBAPixel rgbtree::findNearestNeighbor(const RGBAPixel & query) const
 
 
 
+RGBAPixel rgbtree::findApproximateNeighbor(const RGBAPixel & query, double epsilon,
+                                           long maxVisits, long * visited) const
+{
+  if (liveSize() == 0) { return RGBAPixel(); }
+
+  int bestIndex = -1;
+  int bestDistance = INT_MAX;
+  long visits = 0;
+  double shrink = 1.0 / ((1.0 + epsilon) * (1.0 + epsilon));
+  approximateSearch(query, 0, tree.size()-1, 0, shrink, maxVisits > 0 ? maxVisits : LONG_MAX,
+                    visits, bestIndex, bestDistance);
+
+  if (visited) { *visited += visits; }
+  return tree[bestIndex];
+}
+
+/**
+ * fNN_recursive with an index for the best key and two extra ways to skip
+ * the far side: the (1+epsilon)^2-shrunk radius, and the visit budget. The
+ * visits may overrun maxVisits while the near-side descent finishes, and a
+ * far side is always opened while no live key has been seen.
+ */
+void rgbtree::approximateSearch(const RGBAPixel & query, int start, int end, int dimension, double shrink,
+                                long maxVisits, long & visits, int & bestIndex, int & bestDistance) const
+{
+  if (start > end) { return; }
+
+  if (leafSize > 1 && end - start + 1 <= leafSize)
+  {
+    for (int j = start; j <= end; j++)
+    {
+      int distance = distance3D(query, tree[j]);
+      if (distance < bestDistance && live(j)) { bestDistance = distance; bestIndex = j; }
+    }
+    visits += end - start + 1;
+    return;
+  }
+
+  int median = (start + end) / 2;
+  visits++;
+  int distance = distance3D(query, tree[median]);
+  if (distance < bestDistance && live(median)) { bestDistance = distance; bestIndex = median; }
+
+  int nextDimension = (dimension + 1) % 3;
+  bool left = smallerByDim(query, tree[median], dimension);
+  if (left) { approximateSearch(query, start, median-1, nextDimension, shrink, maxVisits, visits, bestIndex, bestDistance); }
+  else { approximateSearch(query, median+1, end, nextDimension, shrink, maxVisits, visits, bestIndex, bestDistance); }
+
+  //a live key was found on the way down unless everything there was removed
+  //(or, for a warm start, nothing there beat the seeded bound); the budget
+  //never stops the search before it has an answer
+  bool found = bestIndex >= 0;
+  if ((!found || visits < maxVisits) && distToSplit(query, tree[median], dimension) <= bestDistance * shrink)
+  {
+    if (left) { approximateSearch(query, median+1, end, nextDimension, shrink, maxVisits, visits, bestIndex, bestDistance); }
+    else { approximateSearch(query, start, median-1, nextDimension, shrink, maxVisits, visits, bestIndex, bestDistance); }
+  }
+}
+
+RGBAPixel rgbtree::findNearestNeighborFrom(const RGBAPixel & query, const RGBAPixel & hint,
+                                           long * visited) const
+{
+  if (liveSize() == 0) { return RGBAPixel(); }
+
+  //everything at least one farther than the hint is pruned, while ties with
+  //it are still found in the same order as a cold search finds them
+  int bestIndex = -1;
+  int bestDistance = distance3D(query, hint) + 1;
+  long visits = 0;
+  approximateSearch(query, 0, tree.size()-1, 0, 1.0, LONG_MAX, visits, bestIndex, bestDistance);
+
+  //a hint that isn't a live key here may leave nothing within the bound
+  if (bestIndex < 0)
+  {
+    bestDistance = INT_MAX;
+    approximateSearch(query, 0, tree.size()-1, 0, 1.0, LONG_MAX, visits, bestIndex, bestDistance);
+  }
+
+  if (visited) { *visited += visits; }
+  return tree[bestIndex];
+}
+
+/**
+ * Position of a color along a Z-order curve through the RGB cube: the bits
+ * of the three channels interleaved, most significant first, so colors close
+ * in the cube are mostly close in the order.
+ */
+static uint32_t mortonCode(const RGBAPixel & pixel)
+{
+  uint32_t code = 0;
+  for (int bit = 7; bit >= 0; bit--)
+  {
+    code = (code << 3) | ((pixel.r >> bit) & 1) << 2 | ((pixel.g >> bit) & 1) << 1 | ((pixel.b >> bit) & 1);
+  }
+  return code;
+}
+
+void rgbtree::findNearestNeighbors(const vector<RGBAPixel> & queries, vector<RGBAPixel> & results) const
+{
+  findNearestNeighbors(queries, results, NULL);
+}
+
+void rgbtree::findNearestNeighbors(const vector<RGBAPixel> & queries, vector<RGBAPixel> & results,
+                                   long * visited) const
+{
+  results.resize(queries.size());
+  if (queries.empty()) { return; }
+
+  //walk the queries along the Z-order curve so each one starts from the
+  //answer to a nearby color
+  vector<pair<uint32_t, uint32_t> > order(queries.size());
+  for (size_t i = 0; i < queries.size(); i++) { order[i] = make_pair(mortonCode(queries[i]), (uint32_t) i); }
+  sort(order.begin(), order.end());
+
+  long visits = 0;
+  const RGBAPixel * previous = NULL;
+  for (size_t k = 0; k < order.size(); k++)
+  {
+    const RGBAPixel & query = queries[order[k].second];
+    RGBAPixel & result = results[order[k].second];
+    bool repeat = previous && query.r == previous->r && query.g == previous->g && query.b == previous->b;
+    if (repeat) { result = results[order[k-1].second]; }
+    else if (previous) { result = findNearestNeighborFrom(query, results[order[k-1].second], &visits); }
+    else { result = findApproximateNeighbor(query, 0, 0, &visits); }
+    previous = &query;
+  }
+  if (visited) { *visited += visits; }
+}
+
+void rgbtree::findNearestNeighborPackets(const vector<RGBAPixel> & queries, vector<RGBAPixel> & results,
+                                         long * nodes) const
+{
+  results.resize(queries.size());
+  if (queries.empty()) { return; }
+  if (liveSize() == 0)
+  {
+    fill(results.begin(), results.end(), RGBAPixel());
+    return;
+  }
+
+  //similar colors share packets, so their lanes mostly agree on the way down
+  vector<pair<uint32_t, uint32_t> > order(queries.size());
+  for (size_t i = 0; i < queries.size(); i++) { order[i] = make_pair(mortonCode(queries[i]), (uint32_t) i); }
+  sort(order.begin(), order.end());
+
+  long fetched = 0;
+  for (size_t first = 0; first < order.size(); first += PACKET)
+  {
+    int lanes = (int) min<size_t>(PACKET, order.size() - first);
+    queryPacket packet;
+    for (int l = 0; l < PACKET; l++)
+    {
+      //a short last packet repeats its first query in the unused lanes
+      const RGBAPixel & query = queries[order[first + (l < lanes ? l : 0)].second];
+      packet.query[l] = query;
+      packet.c[0][l] = query.r;
+      packet.c[1][l] = query.g;
+      packet.c[2][l] = query.b;
+      packet.bestIndex[l] = -1;
+      packet.bestDistance[l] = INT_MAX;
+    }
+    packet.nodes = 0;
+    packetSearch(packet, 0, tree.size()-1, 0, (1u << lanes) - 1);
+    fetched += packet.nodes;
+
+    for (int l = 0; l < lanes; l++) { results[order[first + l].second] = tree[packet.bestIndex[l]]; }
+  }
+  if (nodes) { *nodes += fetched; }
+}
+
+/**
+ * Whether tree[first] comes before tree[second] in query's own search
+ * order: each node before its subtrees, the side of the query before the
+ * other, a bucket in index order. The single-query search keeps the first
+ * of several equally close keys in that order; the packets visit the tree
+ * in their own order, so they settle ties with this instead.
+ */
+bool rgbtree::precedes(const RGBAPixel & query, int first, int second) const
+{
+  int start = 0, end = tree.size()-1, dimension = 0;
+  while (!(leafSize > 1 && end - start + 1 <= leafSize))
+  {
+    int median = (start + end) / 2;
+    if (first == median || second == median) { return first == median; }
+
+    bool firstLeft = first < median;
+    if (firstLeft != (second < median)) { return firstLeft == smallerByDim(query, tree[median], dimension); }
+    if (firstLeft) { end = median - 1; } else { start = median + 1; }
+    dimension = (dimension + 1) % 3;
+  }
+  return first < second;
+}
+
+void rgbtree::offer(queryPacket & packet, int lane, int index, int distance) const
+{
+  //a tie, the rare case, costs a walk down from the root to settle
+  int & best = packet.bestDistance[lane];
+  if (distance < best || precedes(packet.query[lane], index, packet.bestIndex[lane]))
+  {
+    best = distance;
+    packet.bestIndex[lane] = index;
+  }
+}
+
+void rgbtree::packetSearch(queryPacket & packet, int start, int end, int dimension, unsigned mask) const
+{
+  if (start > end || mask == 0) { return; }
+
+  //once half the lanes have dropped out there is too little left to share
+  //the fetches with: the rest finish the subtree as single queries, bounded
+  //one past their best so that a key tied with it can still be weighed
+  if ((int) bitset<PACKET>(mask).count() <= PACKET / 2)
+  {
+    for (int l = 0; l < PACKET; l++)
+    {
+      if (!(mask >> l & 1)) { continue; }
+      int index = -1;
+      int distance = packet.bestDistance[l] == INT_MAX ? INT_MAX : packet.bestDistance[l] + 1;
+      long visits = 0;
+      approximateSearch(packet.query[l], start, end, dimension, 1.0, LONG_MAX, visits, index, distance);
+      packet.nodes += visits;
+      if (index >= 0) { offer(packet, l, index, distance); }
+    }
+    return;
+  }
+
+  int distances[PACKET], closer[PACKET];
+  if (leafSize > 1 && end - start + 1 <= leafSize)
+  {
+    packet.nodes += end - start + 1;
+    for (int j = start; j <= end; j++)
+    {
+      int kr = leaves[0][j], kg = leaves[1][j], kb = leaves[2][j];
+      for (int l = 0; l < PACKET; l++)
+      {
+        int dr = packet.c[0][l] - kr, dg = packet.c[1][l] - kg, db = packet.c[2][l] - kb;
+        distances[l] = dr * dr + dg * dg + db * db;
+        closer[l] = distances[l] <= packet.bestDistance[l];
+      }
+      if (!live(j)) { continue; }
+      for (int l = 0; l < PACKET; l++)
+      {
+        if ((mask >> l & 1) && closer[l]) { offer(packet, l, j, distances[l]); }
+      }
+    }
+    return;
+  }
+
+  int median = (start + end) / 2;
+  const RGBAPixel & key = tree[median];
+  packet.nodes++;
+
+  //every lane at once: distance to the key and to the splitting plane, and
+  //which side of the plane the lane is on
+  int kr = key.r, kg = key.g, kb = key.b;
+  int split = channel(key, dimension);
+  const int * c = packet.c[dimension];
+  int planes[PACKET], sides[PACKET];
+  for (int l = 0; l < PACKET; l++)
+  {
+    int dr = packet.c[0][l] - kr, dg = packet.c[1][l] - kg, db = packet.c[2][l] - kb;
+    distances[l] = dr * dr + dg * dg + db * db;
+    closer[l] = distances[l] <= packet.bestDistance[l];
+    sides[l] = c[l] - split;
+    planes[l] = sides[l] * sides[l];
+  }
+
+  //lanes on the plane itself go the way smallerByDim sends them
+  bool keyLive = live(median);
+  unsigned nearLeft = 0;
+  for (int l = 0; l < PACKET; l++)
+  {
+    if (!(mask >> l & 1)) { continue; }
+    if (keyLive && closer[l]) { offer(packet, l, median, distances[l]); }
+    if (sides[l] < 0 || (sides[l] == 0 && smallerByDim(packet.query[l], key, dimension))) { nearLeft |= 1u << l; }
+  }
+  unsigned nearRight = mask & ~nearLeft;
+
+  //the side most lanes want first; the others see it as their far side and
+  //enter only if their bound reaches across, as they will the other side
+  int nextDimension = (dimension + 1) % 3;
+  bool leftFirst = bitset<PACKET>(nearLeft).count() >= bitset<PACKET>(nearRight).count();
+  for (int pass = 0; pass < 2; pass++)
+  {
+    bool left = leftFirst == (pass == 0);
+    unsigned lanes = left ? nearLeft : nearRight;
+    for (int l = 0; l < PACKET; l++)
+    {
+      if ((mask >> l & 1) && planes[l] <= packet.bestDistance[l]) { lanes |= 1u << l; }
+    }
+    if (left) { packetSearch(packet, start, median-1, nextDimension, lanes); }
+    else { packetSearch(packet, median+1, end, nextDimension, lanes); }
+  }
+}
+
+size_t rgbtree::findInRadius(const RGBAPixel & query, int radiusSquared, vector<RGBAPixel> & out,
+                            size_t limit, minstd_rand * rng) const
+{
+  out.clear();
+  size_t seen = 0;
+  if (!tree.empty()) { rangeSearch(query, 0, tree.size()-1, 0, radiusSquared, out, limit, rng, seen); }
+  return seen;
+}
+
+void rgbtree::findInRadius(const vector<RGBAPixel> & queries, int radiusSquared,
+                           vector<vector<RGBAPixel> > & out, size_t limit, bool sample,
+                           unsigned seed, unsigned threads) const
+{
+  out.resize(queries.size());
+  parallel::parallelFor(queries.size(), threads, [&](size_t i) {
+    minstd_rand rng(seed + i);
+    findInRadius(queries[i], radiusSquared, out[i], limit, sample ? &rng : NULL);
+  });
+}
+
+/**
+ * Collects the live keys of tree[start..end] within the radius. Returns true
+ * once an unsampled search has reached limit, to stop the whole walk.
+ */
+bool rgbtree::rangeSearch(const RGBAPixel & query, int start, int end, int dimension, int radiusSquared,
+                          vector<RGBAPixel> & out, size_t limit, minstd_rand * rng, size_t & seen) const
+{
+  if (start > end) { return false; }
+
+  //keep key: append while under the limit, then either stop or replace a
+  //uniformly chosen kept key with probability limit/seen
+  auto keep = [&](int index) {
+    seen++;
+    if (limit == 0 || out.size() < limit) { out.push_back(tree[index]); }
+    else if (rng) {
+      size_t slot = (*rng)() % seen;
+      if (slot < limit) { out[slot] = tree[index]; }
+    }
+    return limit > 0 && !rng && out.size() == limit;
+  };
+
+  if (leafSize > 1 && end - start + 1 <= leafSize)
+  {
+    for (int j = start; j <= end; j++)
+    {
+      if (distance3D(query, tree[j]) <= radiusSquared && live(j) && keep(j)) { return true; }
+    }
+    return false;
+  }
+
+  int median = (start + end) / 2;
+  if (distance3D(query, tree[median]) <= radiusSquared && live(median) && keep(median)) { return true; }
+
+  //each side only if the ball reaches across (or into) it
+  int nextDimension = (dimension + 1) % 3;
+  int diff = channel(query, dimension) - channel(tree[median], dimension);
+  bool reachesLeft = diff <= 0 || diff * diff <= radiusSquared;
+  bool reachesRight = diff >= 0 || diff * diff <= radiusSquared;
+
+  if (reachesLeft && rangeSearch(query, start, median-1, nextDimension, radiusSquared, out, limit, rng, seen))
+  { return true; }
+  return reachesRight && rangeSearch(query, median+1, end, nextDimension, radiusSquared, out, limit, rng, seen);
+}
+
+void rgbtree::findNearestNeighbor(const RGBAPixel & query, RGBAPixel & best, int & bestDistance) const
+{
+  if (liveSize() == 0) { return; }
+
+  //the outside best only bounds the search: it isn't a key of this tree, so
+  //it can't be handed to fNN_recursive as one. Search by index, and only a
+  //strictly closer live key replaces it
+  int bestIndex = -1;
+  int distance = bestDistance;
+  long visits = 0;
+  approximateSearch(query, 0, tree.size()-1, 0, 1.0, LONG_MAX, visits, bestIndex, distance);
+  if (bestIndex >= 0)
+  {
+    best = tree[bestIndex];
+    bestDistance = distance;
+  }
+}
+
 RGBAPixel rgbtree::fNN_recursive(const RGBAPixel & query, int start, int end, int dimension, RGBAPixel & bestPixel, int bestDistance) const
 {
   //BASE CASE:
   if (start > end) { return bestPixel; }
+  if (leafSize > 1 && end - start + 1 <= leafSize) { return scanLeaf(query, start, end, bestPixel, bestDistance); }
 
   //CASE 1: 
   int index_rootMin = (start+end)/2;
@@ -91,7 +544,7 @@ RGBAPixel rgbtree::fNN_recursive(const RGBAPixel & query, int start, int end, in
   int distance_root_to_query = distance3D(query, rootMin);
 
   //check if the distance of current node is smaller than bestDistance; if so, replace bestDistance
-  if (distance_root_to_query < bestDistance)
+  if (distance_root_to_query < bestDistance && live(index_rootMin))
   {
     bestPixel = rootMin;
     bestDistance = distance_root_to_query;
@@ -305,154 +758,351 @@ int rgbtree::distance3D(const RGBAPixel & first, const RGBAPixel & second) const
 }
 
 
+// the r, g, b members in dimension order, so coordinate d of a pixel is one
+// indexed load instead of a branch per dimension
+static unsigned char RGBAPixel::* const CHANNELS[3] = { &RGBAPixel::r, &RGBAPixel::g, &RGBAPixel::b };
+
+int rgbtree::channel(const RGBAPixel & pixel, int dimension)
+{
+  return pixel.*CHANNELS[dimension];
+}
+
 // determine if pixel a is smaller than pixel b in dimension curDim
 bool rgbtree::smallerByDim(const RGBAPixel & first,
                                 const RGBAPixel & second, int curDim) const
 {
-  if (curDim == 0)
-  {
-    if (first.r < second.r)
-    return true;
-
-    if (first.r == second.r)
-    return (first < second);
+  //the channel above the packed key: one compare, with operator<'s exact
+  //order breaking ties
+  uint64_t a = (uint64_t) channel(first, curDim) << 32 | first.key();
+  uint64_t b = (uint64_t) channel(second, curDim) << 32 | second.key();
+  return a < b;
+}
 
-    else {return false;}
-  }
 
-  if (curDim == 1)
-  {
-    if (first.g < second.g)
-    return true;
 
-    if (first.g == second.g)
-    return (first < second);
+/**
+ * Helper function to help determine if the nearest neighbor could 
+ * be on the other side of the KD tree.
+ */
+int rgbtree::distToSplit(const RGBAPixel& query, const RGBAPixel& curr, int currDim) const
+{
+  int diff = channel(curr, currDim) - channel(query, currDim);
+  return diff * diff;
+}
 
-    else {return false;}
+/**
+ * Brute force over one bucket: all distances first, in a loop with no
+ * branches over the channel arrays (vectorized), then the minimum. Strict <
+ * against bestDistance, like the tree nodes, so earlier keys win ties.
+ */
+RGBAPixel rgbtree::scanLeaf(const RGBAPixel & query, int start, int end, RGBAPixel & bestPixel, int bestDistance) const
+{
+  int count = end - start + 1;
+  const unsigned char * r = &leaves[0][start];
+  const unsigned char * g = &leaves[1][start];
+  const unsigned char * b = &leaves[2][start];
+  int qr = query.r, qg = query.g, qb = query.b;
+
+  int distances[MAX_LEAF];
+  for (int j = 0; j < count; j++)
+  {
+    int dr = qr - r[j], dg = qg - g[j], db = qb - b[j];
+    distances[j] = dr * dr + dg * dg + db * db;
   }
 
-  if (curDim == 2)
+  int best = -1;
+  for (int j = 0; j < count; j++)
   {
-    if (first.b < second.b)
-    return true;
+    if (distances[j] < bestDistance && live(start + j)) { bestDistance = distances[j]; best = j; }
+  }
+  if (best >= 0) { bestPixel = tree[start + best]; }
+  return bestPixel;
+}
+
+//////////////////////////////////////
 
-    if (first.b == second.b)
-    return (first < second);
+////////////////////////////////////// TOMBSTONES
 
-    else {return false;}
-  }
-  cout << "Error in smallerByDim, this line of code should not be reached." << endl; 
+static bool sameKey(const RGBAPixel & a, const RGBAPixel & b)
+{
+  return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
 }
 
+bool rgbtree::remove(const RGBAPixel & key)
+{
+  int index = locate(key, 0, tree.size()-1, 0);
+  if (index < 0) { return false; }
 
+  if (removed.empty()) { removed.assign(tree.size(), 0); }
+  removed[index] = 1;
+  removedCount++;
+  return true;
+}
 
 /**
- * Helper function to help determine if the nearest neighbor could 
- * be on the other side of the KD tree.
+ * Index of a live copy of key in tree[start..end], or -1. Keys equal to a
+ * node's key in its splitting dimension may sit on either side, so ties
+ * search both.
  */
-int rgbtree::distToSplit(const RGBAPixel& query, const RGBAPixel& curr, int currDim) const
+int rgbtree::locate(const RGBAPixel & key, int start, int end, int dimension) const
 {
-  if (currDim == 0)
-  { 
-    int currentR = (int)curr.r; 
-    int queryR = (int)query.r;
-    return (currentR-queryR)*(currentR-queryR); 
-  }
+  if (start > end) { return -1; }
 
-  if (currDim == 1)
-  { 
-    int currentG = (int)curr.g; 
-    int queryG = (int)query.g;
-    return (currentG-queryG)*(currentG-queryG); 
+  if (leafSize > 1 && end - start + 1 <= leafSize)
+  {
+    for (int j = start; j <= end; j++)
+    {
+      if (sameKey(tree[j], key) && live(j)) { return j; }
+    }
+    return -1;
   }
 
-  if (currDim == 2)
-  { 
-    int currentB = (int)curr.b;
-    int queryB = (int)query.b;
-    return (currentB-queryB)*(currentB-queryB); 
+  int median = (start + end) / 2;
+  if (sameKey(tree[median], key) && live(median)) { return median; }
+
+  int nextDimension = (dimension + 1) % 3;
+  int here = channel(tree[median], dimension), wanted = channel(key, dimension);
+  if (wanted <= here)
+  {
+    int found = locate(key, start, median-1, nextDimension);
+    if (found >= 0) { return found; }
   }
+  if (wanted >= here) { return locate(key, median+1, end, nextDimension); }
+  return -1;
 }
 
 //////////////////////////////////////
 
 ////////////////////////////////////// QUICKSELECT + HELPERS
 
+void rgbtree::selectMedian(int start, int end, int k, int d, unsigned threads)
+{
+  if (method == HISTOGRAM) { histogramSelect(start, end, k, d, threads); }
+  else { quickSelectParallel(start, end, k, d, threads); }
+}
+
 /**
  * This function splits the trees[start..end] subarray at position start k
  */
 void rgbtree::quickSelect(int start, int end, int k, int d)
 {
-  //stop. A[k] contains the kth ordered element.
-  if (start >= end)
-  { return; }
+  quickSelectParallel(start, end, k, d, 1);
+}
 
-  int p = partition(start, end, d);
+/**
+ * Introselect: partition around a cheap sampled pivot (choosePivot) and keep
+ * the side holding k, like quickSelect always did, but count the steps that
+ * keep more than 3/4 of the range. Once there have been more of those than
+ * log2 of the range -- sorted, adversarial or duplicate-heavy input -- the
+ * pivot becomes the exact median (medianValue, linear time), so the whole
+ * selection stays O(n). Keys equal to the pivot are gathered in the middle
+ * and end the search if k lands among them, so flat-color libraries cost a
+ * single pass.
+ */
+void rgbtree::quickSelectParallel(int start, int end, int k, int d, unsigned threads)
+{
+  int allowedBadSplits = 0;
+  for (int n = end - start + 1; n > 1; n >>= 1) { allowedBadSplits++; }
+  int badSplits = 0;
 
-  if(k < p)
-  //search left of pivot.
-  { quickSelect(start, p-1, k, d); }
+  while (start < end)
+  {
+    int n = end - start + 1;
+    int x = badSplits > allowedBadSplits ? medianValue(start, end, d) : choosePivot(start, end, d);
 
-  if (k > p)
-  //search right of pivot.
-  { quickSelect(p+1, end, k, d); }
+    //the big ranges are split by all threads; both produce the same order
+    int lt, gt;
+    if (threads > 1 && n > PARALLEL_CUTOFF) { partitionParallel(start, end, d, x, lt, gt, threads); }
+    else { partition(start, end, d, x, lt, gt); }
 
-  if (k == p)
-  //stop, k is now in the right place.
-  { return; }
+    if (k < lt) { end = lt-1; }
+    else if (k > gt) { start = gt+1; }
+    else { return; }  //k is among the keys equal to the pivot
+
+    if (4 * (end - start + 1) > 3 * n) { badSplits++; }
+  }
+}
+
+static inline int median3(int a, int b, int c)
+{
+  return max(min(a, b), min(max(a, b), c));
+}
+
+/**
+ * Pivot value for tree[lo..hi] in dimension d: the median of the first,
+ * middle and last keys, or for larger ranges Tukey's ninther (the median of
+ * three such medians spread across the range). Sorted and reversed input
+ * both give the true median this way.
+ */
+int rgbtree::choosePivot(int lo, int hi, int d) const
+{
+    int n = hi - lo + 1, mid = lo + (n - 1) / 2;
+    if (n < 128) {
+        return median3(channel(tree[lo], d), channel(tree[mid], d), channel(tree[hi], d));
+    }
+    int s = n / 8;
+    return median3(median3(channel(tree[lo], d), channel(tree[lo + s], d), channel(tree[lo + 2*s], d)),
+                   median3(channel(tree[mid - s], d), channel(tree[mid], d), channel(tree[mid + s], d)),
+                   median3(channel(tree[hi - 2*s], d), channel(tree[hi - s], d), channel(tree[hi], d)));
+}
+
+// k-th smallest of v[0..n) by median of medians (BFPRT); reorders v
+static int selectValue(unsigned char * v, size_t n, size_t k)
+{
+  while (n > 5)
+  {
+    //medians of groups of 5 to the front, then their median as the pivot
+    size_t m = 0;
+    for (size_t g = 0; g < n; g += 5)
+    {
+      size_t e = min(g + 5, n);
+      sort(v + g, v + e);
+      swap(v[m++], v[g + (e - g - 1) / 2]);
+    }
+    int pivot = selectValue(v, m, (m - 1) / 2);
+
+    unsigned char * lt = partition(v, v + n, [&](unsigned char c) { return c < pivot; });
+    unsigned char * gt = partition(lt, v + n, [&](unsigned char c) { return c == pivot; });
+    size_t less = lt - v, notGreater = gt - v;
+
+    if (k < less) { n = less; }
+    else if (k < notGreater) { return pivot; }
+    else { v += notGreater; n -= notGreater; k -= notGreater; }
+  }
+  sort(v, v + n);
+  return v[k];
+}
+
+/**
+ * Exact median of tree[lo..hi] in dimension d, in linear worst-case time.
+ * Works on a copy of the channel values so tree's order is untouched.
+ */
+int rgbtree::medianValue(int lo, int hi, int d) const
+{
+    vector<unsigned char> values(hi - lo + 1);
+    for (int j = lo; j <= hi; j++) { values[j - lo] = channel(tree[j], d); }
+    return selectValue(values.data(), values.size(), (values.size() - 1) / 2);
 }
 
+/**
+ * Counting select: channels are bytes, so one pass fills a 256-bin histogram
+ * of tree[start..end] in dimension d, the running count finds the value of
+ * the k-th key, and one three-way partition around that value puts k in
+ * place. Two linear passes per node, no comparisons, no bad cases. Ranges
+ * under 64 keys, where the bins dominate, go to quickSelect instead.
+ */
+void rgbtree::histogramSelect(int start, int end, int k, int d, unsigned threads)
+{
+  //small ranges: clearing and scanning 256 bins costs more than selecting
+  int n = end - start + 1;
+  if (n < 64) { quickSelectParallel(start, end, k, d, 1); return; }
+
+  int counts[256] = {0};
+  if (threads > 1 && n > PARALLEL_CUTOFF)
+  {
+    //a histogram per block, summed afterwards
+    const int BLOCK = PARALLEL_CUTOFF / 4;
+    int blocks = (n + BLOCK - 1) / BLOCK;
+    vector<int> blockCounts((size_t) blocks * 256, 0);
+    parallel::parallelFor(blocks, threads, [&](size_t b) {
+      int from = start + b * BLOCK, to = min(from + BLOCK, end + 1);
+      int * local = &blockCounts[b * 256];
+      for (int j = from; j < to; j++) { local[channel(tree[j], d)]++; }
+    });
+    for (int b = 0; b < blocks; b++) {
+      for (int v = 0; v < 256; v++) { counts[v] += blockCounts[(size_t) b * 256 + v]; }
+    }
+  }
+  else
+  {
+    for (int j = start; j <= end; j++) { counts[channel(tree[j], d)]++; }
+  }
+
+  int x = 0;
+  for (int below = counts[0]; below <= k - start; below += counts[++x]) {}
+
+  int lt, gt;
+  if (threads > 1 && n > PARALLEL_CUTOFF) { partitionParallel(start, end, d, x, lt, gt, threads); }
+  else { partition(start, end, d, x, lt, gt); }
+}
 
 /**
  * This method does a partition around pivot and will be used 
- * in quick select. It uses tree[lo] as the default pivot.
- * It returns the index of the pivot in the updated vector.
- * You will likely need to modify and complete this code.
+ * in quick select. It is a stable three-way partition around the pivot
+ * value x: on return tree[lo..lt-1] < x, tree[lt..gt] == x and
+ * tree[gt+1..hi] > x (in dimension d), each group in its original order.
  */
-int rgbtree::partition(int lo, int hi, int d) 
+void rgbtree::partition(int lo, int hi, int d, int x, int & lt, int & gt) 
 
 { 
-    if (d == 0)
-    {
-    RGBAPixel x = tree[hi];
-    int idx = lo; 
-    for (int j = lo; j <= hi - 1; j++) { 
-        if (tree[j].r <= x.r) { 
-            swap(tree[idx], tree[j]); 
-            idx++; 
-        } 
-    } 
-    swap(tree[idx], tree[hi]); 
-    return idx;
+    //smaller keys are compacted in place; equal keys fill scratch upward from
+    //lo and larger ones downward from hi, so the two never meet. every key is
+    //written to all three and only one cursor moves: no branches.
+    int idx = lo, eq = lo, big = hi; 
+    for (int j = lo; j <= hi; j++) { 
+        RGBAPixel p = tree[j];
+        int c = channel(p, d);
+        tree[idx] = p;
+        scratch[eq] = p;
+        scratch[big] = p;
+        idx += c < x;
+        eq += c == x;
+        big -= c > x;
     } 
+    lt = idx;
+    gt = idx + (eq - lo) - 1;
+    copy(scratch.begin() + lo, scratch.begin() + eq, tree.begin() + lt);
+    reverse_copy(scratch.begin() + big + 1, scratch.begin() + hi + 1, tree.begin() + gt + 1);
+}
 
-    if (d == 1)
-    {
-    RGBAPixel x = tree[hi];
-    int idx = lo; 
-    for (int j = lo; j <= hi - 1; j++) { 
-        if (tree[j].g <= x.g) { 
-            swap(tree[idx], tree[j]); 
-            idx++; 
-        } 
-    } 
-    swap(tree[idx], tree[hi]); 
-    return idx;
-    } 
+/**
+ * partition, split over threads: each block of tree[lo..hi] counts its
+ * smaller and equal keys, prefix sums give every block its output offsets in
+ * all three groups, and the blocks scatter into scratch in parallel before it
+ * is copied back. The result is the same stable order partition produces.
+ */
+void rgbtree::partitionParallel(int lo, int hi, int d, int x, int & lt, int & gt, unsigned threads)
+{
+    const int BLOCK = PARALLEL_CUTOFF / 4;
+    int blocks = (hi - lo + 1 + BLOCK - 1) / BLOCK;
+
+    vector<int> smallBefore(blocks + 1, 0), equalBefore(blocks + 1, 0);
+    parallel::parallelFor(blocks, threads, [&](size_t b) {
+      int from = lo + b * BLOCK, to = min(from + BLOCK, hi + 1);
+      int small = 0, equal = 0;
+      for (int j = from; j < to; j++) {
+        int c = channel(tree[j], d);
+        small += c < x;
+        equal += c == x;
+      }
+      smallBefore[b + 1] = small;
+      equalBefore[b + 1] = equal;
+    });
+    for (int b = 0; b < blocks; b++) {
+      smallBefore[b + 1] += smallBefore[b];
+      equalBefore[b + 1] += equalBefore[b];
+    }
 
-    if (d == 2)
-    {
-    RGBAPixel x = tree[hi];
-    int idx = lo; 
-    for (int j = lo; j <= hi - 1; j++) { 
-        if (tree[j].b <= x.b) { 
-            swap(tree[idx], tree[j]); 
-            idx++; 
-        } 
-    } 
-    swap(tree[idx], tree[hi]); 
-    return idx;
-    } 
+    lt = lo + smallBefore[blocks];
+    gt = lt + equalBefore[blocks] - 1;
+    parallel::parallelFor(blocks, threads, [&](size_t b) {
+      int from = lo + b * BLOCK, to = min(from + BLOCK, hi + 1);
+      int small = lo + smallBefore[b];
+      int equal = lt + equalBefore[b];
+      int big = gt + 1 + (from - lo - smallBefore[b] - equalBefore[b]);
+      for (int j = from; j < to; j++) {
+        RGBAPixel p = tree[j];
+        int c = channel(p, d);
+        if (c < x) { scratch[small++] = p; }
+        else if (c == x) { scratch[equal++] = p; }
+        else { scratch[big++] = p; }
+      }
+    });
+
+    parallel::parallelFor(blocks, threads, [&](size_t b) {
+      int from = lo + b * BLOCK, to = min(from + BLOCK, hi + 1);
+      copy(scratch.begin() + from, scratch.begin() + to, tree.begin() + from);
+    });
 }
 
 //////////////////////////////////////
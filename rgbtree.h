@@ -12,6 +12,8 @@
 #include "cs221util/RGBAPixel.h"
 #include <vector>
 #include <map>
+#include <random>
+#include "nnindex.h"
 using namespace std;
 using namespace cs221util;
 
@@ -31,9 +33,21 @@ using namespace cs221util;
  *
  * This file will be submitted for grading, so you are welcome to add 
  * helper functions and auxiliary data.
+ *
+ * rgbtree is the default nnindex engine: matching by Euclidean distance in
+ * raw sRGB.
  */
 
-class rgbtree {
+class rgbtree : public nnindex {
+
+public:
+
+    /**
+     * How buildTree finds each median: quickSelect (introselect, the PA3
+     * algorithm) or a 256-bin counting pass, which exploits the 8-bit
+     * channels. Both give a valid tree, though not the same array.
+     */
+    enum medianMethod { QUICKSELECT, HISTOGRAM };
 
 //private:
 public:
@@ -87,9 +101,38 @@ public:
     * segment of the array, searching for the median element. The precise
     * parameter to use for the recursive call is for you to figure out
     * when you complete your implementation.
+    *
+    * Parallel build:
+    * Large ranges are partitioned by all threads at once (a stable
+    * partition: count, prefix sum, scatter), and once the top levels have
+    * produced enough independent subtrees they are built concurrently. Every
+    * partition is stable, serial or not, so the resulting array does not
+    * depend on the thread count.
+    *
+    * Leaf buckets:
+    * With leafSize > 1, ranges of at most leafSize keys are not split any
+    * further: they stay unordered buckets that the search scans with one
+    * straight-line distance loop over a struct-of-arrays copy of the
+    * channels, which the compiler vectorizes. The tree is log2(leafSize)
+    * levels shallower, and all the branching near the bottom is gone.
+    *
+    * @param threads worker count for the build; 0 means all cores, 1 builds
+    *  serially.
+    * @param method how each median is found.
+    * @param leafSize largest unsplit range, clamped to [1, MAX_LEAF]; 1 is the
+    *  plain PA3 tree.
     */
 
-    rgbtree( const map< RGBAPixel, string> & photos);
+    rgbtree( const map< RGBAPixel, string> & photos, unsigned threads = 0,
+             medianMethod method = QUICKSELECT, int leafSize = 1);
+
+    /**
+     * Builds a rgbtree over keys as given: any order, duplicates allowed.
+     */
+    rgbtree( const vector<RGBAPixel> & keys, unsigned threads = 0,
+             medianMethod method = QUICKSELECT, int leafSize = 1);
+
+    static constexpr int MAX_LEAF = 64;
     
     /**
      * Finds the closest point to the parameter (query) point in the RGBTree.
@@ -132,6 +175,120 @@ public:
      */
     RGBAPixel findNearestNeighbor(const RGBAPixel & query) const;
 
+    /**
+     * Approximate nearest neighbor, for previews and latency-bound callers.
+     * The far side of a split is searched only if the splitting plane is
+     * within bestDistance / (1+epsilon)^2 (squared), so the answer is at most
+     * (1+epsilon) times as far as the true nearest neighbor; epsilon 0 is the
+     * exact search. maxVisits additionally caps the nodes examined: once it
+     * is spent no far side is opened, though the descent toward the query
+     * always finishes, so some answer is always found.
+     *
+     * @param epsilon relative error bound on the (unsquared) distance.
+     * @param maxVisits node budget; 0 means no budget.
+     * @param visited if not NULL, incremented by the nodes examined.
+     */
+    RGBAPixel findApproximateNeighbor(const RGBAPixel & query, double epsilon,
+                                      long maxVisits = 0, long * visited = NULL) const;
+
+    /**
+     * Warm-started search, for queries that arrive in a coherent order: the
+     * bound starts at hint's distance instead of the root's, so subtrees the
+     * hint already beats are never opened. The answer (ties included) is the
+     * same as findNearestNeighbor(query); a hint that isn't a live key of
+     * this tree just costs a second, cold search.
+     *
+     * @param hint usually the answer for the previous, similar query.
+     * @param visited if not NULL, incremented by the nodes examined.
+     */
+    RGBAPixel findNearestNeighborFrom(const RGBAPixel & query, const RGBAPixel & hint,
+                                      long * visited = NULL) const;
+
+    /**
+     * Batch search with warm starts: the queries are visited along a Z-order
+     * curve through the color cube, each seeded with the previous answer,
+     * and a query identical to the previous one reuses its answer outright.
+     * results[i] is findNearestNeighbor(queries[i]).
+     */
+    void findNearestNeighbors(const vector<RGBAPixel> & queries, vector<RGBAPixel> & results) const;
+
+    /**
+     * As above. visited, if not NULL, is incremented by the nodes examined.
+     */
+    void findNearestNeighbors(const vector<RGBAPixel> & queries, vector<RGBAPixel> & results,
+                              long * visited) const;
+
+    /** Lanes in a query packet. */
+    static constexpr int PACKET = 8;
+
+    /**
+     * Batch search by packets, as ray tracers trace rays: the queries are
+     * ordered along a Z-order curve and cut into packets of PACKET similar
+     * colors, and each packet walks the tree once. A node is fetched once
+     * for the whole packet and tested against every lane at a time; lanes
+     * whose bound rules a subtree out are masked off, and the walk stops
+     * where every lane is masked; once half of them are, the rest go on as
+     * single queries. Each lane keeps the answer findNearestNeighbor would
+     * give, ties included.
+     *
+     * This pays when node fetches dominate. Here a node is one 4-byte key
+     * and the lanes of even a dense batch part ways within a few levels,
+     * so on the machines measured (bench packets) the packets save fetches
+     * on small trees but still run slower than findNearestNeighbors; they
+     * are kept as an option rather than the default.
+     *
+     * @param nodes if not NULL, incremented by the nodes fetched (once per
+     *  packet, however many lanes use them).
+     */
+    void findNearestNeighborPackets(const vector<RGBAPixel> & queries, vector<RGBAPixel> & results,
+                                    long * nodes = NULL) const;
+
+    /**
+     * Range query: every live key within squared distance radiusSquared of
+     * query (inclusive), visiting only the subtrees whose splitting plane is
+     * within the radius. For "any tile that is good enough" selection.
+     *
+     * @param out cleared, then filled with the keys found.
+     * @param limit 0 returns every key in range. Otherwise at most limit keys:
+     *  without rng, the first limit found, and the search stops there; with
+     *  rng, a uniform sample of all the keys in range (reservoir sampling,
+     *  so the whole range is still walked but only limit keys are kept).
+     * @param rng random source for sampling, or NULL.
+     * @return how many keys in range were seen: all of them, unless the
+     *  search stopped early at limit.
+     */
+    size_t findInRadius(const RGBAPixel & query, int radiusSquared, vector<RGBAPixel> & out,
+                        size_t limit = 0, minstd_rand * rng = NULL) const;
+
+    /**
+     * Batch form, spread over threads: out[i] is findInRadius of queries[i].
+     * When sampling, query i draws from its own generator seeded with
+     * seed + i, so results don't depend on the thread count.
+     */
+    void findInRadius(const vector<RGBAPixel> & queries, int radiusSquared,
+                      vector<vector<RGBAPixel> > & out, size_t limit = 0, bool sample = false,
+                      unsigned seed = 1, unsigned threads = 0) const;
+
+    /**
+     * Continues a search begun elsewhere (another tree of a dynrgbtree):
+     * replaces best and bestDistance only if a live key here is strictly
+     * closer than bestDistance, which also prunes everything farther.
+     */
+    void findNearestNeighbor(const RGBAPixel & query, RGBAPixel & best, int & bestDistance) const;
+
+    /**
+     * Deletes one key, exactly equal in all four channels, by marking it with
+     * a tombstone: it keeps its place (and still splits space) but is never
+     * returned by findNearestNeighbor again. O(log n) for distinct keys.
+     * dynrgbtree rebuilds trees once tombstones pile up.
+     *
+     * @return false if no live copy of key is in the tree.
+     */
+    bool remove(const RGBAPixel & key);
+
+    /** Number of keys not removed. */
+    int liveSize() const { return (int) tree.size() - removedCount; }
+
   /* =============== end of public PA3 FUNCTIONS =========================*/
 
     // Errata fix: changing private to public 
@@ -148,7 +305,8 @@ public:
      * smallerByDim
      *
      * Determines if pixel a is smaller than pixel b in a given dimension d.
-     * If there is a tie, break it with RGBAPixel::operator<().
+     * If there is a tie, break it with RGBAPixel::operator<(), the exact
+     * order of the packed keys.
      *
      * For example:
      *
@@ -174,13 +332,21 @@ public:
     * 
     * The algorithm for accomplishing this "semi-sort" of the data involves 
     * repeated application of the partition function, as described in the kdtree
-    * constructor comments, above.
+    * constructor comments, above. It is an introselect: sampled pivots, with
+    * an exact linear-time median as the pivot once they keep splitting badly.
     */
     void quickSelect(int start, int end, int k, int d);
 
     /** Helper function to do partition for quick select. */
     /* You should adapt the code you were given in HW2 for this one */
-    int partition(int lo, int hi, int d);
+    /* Three-way around the pivot value x, leaving [lt, gt] == x. Stable: every
+     * group keeps its relative order (through scratch[lo..hi]), so
+     * partitionParallel can reproduce it. */
+    void partition(int lo, int hi, int d, int x, int & lt, int & gt);
+
+    /* pivot values: median of 3 or ninther, and the exact median fallback */
+    int choosePivot(int lo, int hi, int d) const;
+    int medianValue(int lo, int hi, int d) const;
 
 
     /* distToSplit 
@@ -191,8 +357,52 @@ public:
 
     ////////////////////////////////////////////////////////////////////////////// my own helpers
 
+    void build(unsigned threads);
     void buildTree(int start, int end, int median, int dimension);
 
+    /* parallel build: top levels breadth first, partitioning each large range
+     * with every thread, then the remaining subtrees as independent tasks */
+    void buildTreeParallel(int start, int end, int median, int dimension, unsigned threads);
+    void quickSelectParallel(int start, int end, int k, int d, unsigned threads);
+    void histogramSelect(int start, int end, int k, int d, unsigned threads);
+    void selectMedian(int start, int end, int k, int d, unsigned threads);
+    void partitionParallel(int lo, int hi, int d, int x, int & lt, int & gt, unsigned threads);
+
+    vector<RGBAPixel> scratch; // partition buffer, sized to tree during the build
+    medianMethod method;
+
+    /* leaf buckets: leaves[c][i] is channel c of tree[i], filled when
+     * leafSize > 1; scanLeaf checks a whole bucket against the best so far */
+    int leafSize;
+    vector<unsigned char> leaves[3];
+    void approximateSearch(const RGBAPixel & query, int start, int end, int dimension, double shrink,
+                           long maxVisits, long & visits, int & bestIndex, int & bestDistance) const;
+    bool rangeSearch(const RGBAPixel & query, int start, int end, int dimension, int radiusSquared,
+                     vector<RGBAPixel> & out, size_t limit, minstd_rand * rng, size_t & seen) const;
+    RGBAPixel scanLeaf(const RGBAPixel & query, int start, int end, RGBAPixel & bestPixel, int bestDistance) const;
+
+    /* tombstones: removed[i] marks tree[i] deleted (sized on the first
+     * remove) */
+    vector<unsigned char> removed;
+    int removedCount;
+    bool live(int index) const { return removedCount == 0 || !removed[index]; }
+    int locate(const RGBAPixel & key, int start, int end, int dimension) const;
+
+    /* query packets: PACKET queries walk the tree together, one lane each.
+     * c holds the lanes' channels side by side so every node is tested
+     * against all of them in straight-line loops; mask bits mark the lanes
+     * that still need a subtree */
+    struct queryPacket {
+        int c[3][PACKET];
+        RGBAPixel query[PACKET];
+        int bestIndex[PACKET];
+        int bestDistance[PACKET];
+        long nodes;
+    };
+    void packetSearch(queryPacket & packet, int start, int end, int dimension, unsigned mask) const;
+    void offer(queryPacket & packet, int lane, int index, int distance) const;
+    bool precedes(const RGBAPixel & query, int first, int second) const;
+
     //RGBAPixel findNearestNeighbor_RecursiveHelper(const RGBAPixel & query, int start, int end, int dimension, int bestDistance, RGBAPixel closest) const;
     //void fNN_recursive(const RGBAPixel & query, int start, int end, int dimension, const RGBAPixel & closest) const;
     // void fNN_recursive(const RGBAPixel & query, int start, int end, int dimension, RGBAPixel & closest) const;
@@ -205,6 +415,13 @@ public:
 
     int distance3D(const RGBAPixel & first, const RGBAPixel & second) const;
 
+    /* channel
+     *  Coordinate of pixel in the given dimension (0 = r, 1 = g, 2 = b), read
+     *  through a table of member pointers so no code path branches on the
+     *  dimension. kdtree.h generalizes this tree to other point types.
+     */
+    static int channel(const RGBAPixel & pixel, int dimension);
+
 };
 #endif
 
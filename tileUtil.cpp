@@ -6,35 +6,74 @@
 
 
 #include "tileUtil.h"
+#include "parallel.h"
+#include "cs221util/lodepng/lodepng.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * distinctColors: the distinct colors of queries in first-seen order, and for
+ * each query the index of its color in that list. Open addressing on the
+ * packed 24-bit color (plus one, so zero marks an empty slot), with the table
+ * kept at most half full.
+ */
+static void distinctColors(const vector<RGBAPixel> & queries, vector<RGBAPixel> & colors,
+                           vector<uint32_t> & slots)
+{
+    size_t capacity = 64;
+    while (capacity < 2 * min<size_t>(queries.size(), 1 << 24)) { capacity *= 2; }
+    vector<uint32_t> keys(capacity, 0), indices(capacity);
+    size_t mask = capacity - 1;
+
+    colors.clear();
+    slots.resize(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        const RGBAPixel & q = queries[i];
+        uint32_t key = q.rgb() + 1;
+        size_t h = (key * 2654435761u) & mask;
+        while (keys[h] != 0 && keys[h] != key) { h = (h + 1) & mask; }
+        if (keys[h] == 0) {
+            keys[h] = key;
+            indices[h] = colors.size();
+            colors.push_back(q);
+        }
+        slots[i] = indices[h];
+    }
+}
 
 /**
  * Function tile:
  * @param PNG & target: an image to use as base for the mosaic. it's pixels will be
  *                      be replaced by thumbnail images whose average color is close
  *                      to the pixel.
- * @param rgbtree & ss: a kd-tree of RGBAPixels, used as a query structure for
+ * @param nnindex & ss: the matching engine, used as a query structure for
  *                      nearest neighbor search. 
  * @param map<RGBAPixel, string> & photos: a map that takes a color key and returns the
  *                      filename of an image whose average color is that key.
+ * @param unsigned tileSize: edge length of the (square) thumbnails in photos.
+ * @param tileStats * stats: optional counts and timing for the run report.
  *
- * returns: a PNG whose dimensions are TILESIZE times that of the target. Each
- * pixel in the target is used as a query to ss.findNearestNeighbor, and the response
- * is used as a key in photos. 
+ * returns: a PNG whose dimensions are tileSize times that of the target. The
+ * distinct colors of the target are queried in batches with
+ * ss.findNearestNeighbors, and each response is used as a key in photos. 
  */
 
-PNG tiler::tile(PNG & target, const rgbtree & ss, map<RGBAPixel,string> & photos)
+PNG tiler::tile(PNG & target, const nnindex & ss, map<RGBAPixel,string> & photos,
+                unsigned tileSize, tileStats * stats)
 {   
     PNG mosaic = PNG(target);
 
-    //since each pixel is replaced by a 30x30 thumbnail, we expand each dimension by a factor of 30
-    unsigned int newHeight = target.height() * 30;
-    unsigned int newWidth = target.width() * 30;
+    //since each pixel is replaced by a tileSize x tileSize thumbnail, we expand each dimension by a factor of tileSize
+    unsigned int newHeight = target.height() * tileSize;
+    unsigned int newWidth = target.width() * tileSize;
     mosaic.resize(newWidth, newHeight);
 
-    //for each pixel in target, do NN search with it on rgbtree ss
-    //NN search will return a pixel (closest point), which will be a key in photos map
-    //plug the key into photos map to get a string representing filepath to a thumbnail
-    //put the thumbnail onto mosaic
+    //collect every pixel in target (opaque, so alpha never enters the match)
+    vector<RGBAPixel> queries;
+    queries.reserve((size_t) target.width() * target.height());
     for (unsigned x = 0; x < target.width(); x++) {
         for (unsigned y = 0; y < target.height(); y++) {
 
@@ -43,27 +82,140 @@ PNG tiler::tile(PNG & target, const rgbtree & ss, map<RGBAPixel,string> & photos
             querySub.r = query->r;
             querySub.g = query->g;
             querySub.b = query->b;
-            // RGBAPixel querySub = RGBAPixel();
-            // querySub.r = 200;
-            // querySub.g = 200;
-            // querySub.b = 200;
-            RGBAPixel closest = ss.findNearestNeighbor(querySub);
+            queries.push_back(querySub);
+        }
+    }
+
+    //search each distinct color once. the colors go to the engine in batches,
+    //so engines that convert colors or share traversal work still amortize it,
+    //and the batches run on all threads
+    auto start = chrono::steady_clock::now();
+    vector<RGBAPixel> colors;
+    vector<uint32_t> slots;
+    distinctColors(queries, colors, slots);
+
+    const size_t BATCH = 1024;
+    vector<RGBAPixel> answers(colors.size());
+    parallel::parallelFor((colors.size() + BATCH - 1) / BATCH, 0, [&](size_t b) {
+        size_t first = b * BATCH, last = min(colors.size(), first + BATCH);
+        vector<RGBAPixel> batch(colors.begin() + first, colors.begin() + last), found;
+        ss.findNearestNeighbors(batch, found);
+        copy(found.begin(), found.end(), answers.begin() + first);
+    });
+
+    if (stats) {
+        stats->pixels = queries.size();
+        stats->distinct = colors.size();
+        stats->searchSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    //NN search returned a pixel (closest point) per distinct color, which is a key in photos map
+    //plug the key into photos map to get a string representing filepath to a thumbnail
+    //put the thumbnail onto mosaic
+    size_t next = 0;
+    for (unsigned x = 0; x < target.width(); x++) {
+        for (unsigned y = 0; y < target.height(); y++) {
+
+            RGBAPixel closest = answers[slots[next++]];
             string filePath = photos[closest];
             PNG thumbnail; thumbnail.readFromFile(filePath);
 
             //PNG thumbnail; thumbnail.readFromFile("imlib/99359743_aa94427a3f_s.png");
 
-            render(30*x, 30*y, mosaic, thumbnail);
+            render(tileSize*x, tileSize*y, mosaic, thumbnail);
                   
         }
     }
     return mosaic;
 }
 
+PNG tiler::tileIndexed(const indexedImage & target, const nnindex & ss, map<RGBAPixel,string> & photos,
+                       unsigned tileSize, tileStats * stats)
+{
+    //the same canvas tile builds: its resized copy of the target keeps the target's
+    //alpha in the top-left width x height pixels, which render never overwrites
+    PNG mosaic(target.width * tileSize, target.height * tileSize);
+    for (unsigned y = 0; y < target.height; y++) {
+        for (unsigned x = 0; x < target.width; x++) {
+            mosaic.getPixel(x, y)->a = target.palette[target.indices[(size_t) y * target.width + x]].a;
+        }
+    }
+
+    //search the palette (opaque, like tile's queries) instead of the pixels
+    auto start = chrono::steady_clock::now();
+    vector<RGBAPixel> queries(target.palette.size()), answers;
+    for (size_t i = 0; i < queries.size(); i++) {
+        queries[i].r = target.palette[i].r;
+        queries[i].g = target.palette[i].g;
+        queries[i].b = target.palette[i].b;
+    }
+    ss.findNearestNeighbors(queries, answers);
+
+    if (stats) {
+        stats->pixels = target.indices.size();
+        stats->distinct = queries.size();
+        stats->searchSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    //each palette entry's thumbnail is read the first time the entry is used
+    vector<PNG> thumbnails(target.palette.size());
+    vector<bool> loaded(target.palette.size(), false);
+    for (unsigned y = 0; y < target.height; y++) {
+        for (unsigned x = 0; x < target.width; x++) {
+            unsigned char index = target.indices[(size_t) y * target.width + x];
+            if (!loaded[index]) {
+                thumbnails[index].readFromFile(photos[answers[index]]);
+                loaded[index] = true;
+            }
+            render(tileSize*x, tileSize*y, mosaic, thumbnails[index]);
+        }
+    }
+    return mosaic;
+}
+
+/**
+ * renderFixed: blit kernel for an N x N thumbnail. Rows of a PNG are contiguous,
+ * so each row is fetched once and the N-pixel copy has a compile-time trip count
+ * the compiler can fully unroll. The caller guarantees the tile fits.
+ */
+template <unsigned N>
+static void renderFixed(int xPos, int yPos, PNG & mosaic, PNG & thumbnail)
+{
+    for (unsigned j = 0; j < N; j++) {
+        const RGBAPixel * src = thumbnail.getPixel(0, j);
+        RGBAPixel * dst = mosaic.getPixel(xPos, yPos + j);
+        for (unsigned i = 0; i < N; i++) {
+            dst[i].r = src[i].r;
+            dst[i].g = src[i].g;
+            dst[i].b = src[i].b;
+        }
+    }
+}
+
 void tiler::render(int xPos, int yPos, PNG & mosaic, PNG & thumbnailTester)
 {
-    for (unsigned i = 0; i < thumbnailTester.width(); i++) {
-        for (unsigned j = 0; j < thumbnailTester.height(); j++) {
+    unsigned size = thumbnailTester.width();
+    bool fits = thumbnailTester.height() == size
+             && xPos >= 0 && yPos >= 0
+             && xPos + size <= mosaic.width()
+             && yPos + size <= mosaic.height();
+
+    if (fits) {
+        switch (size) {
+            case 16: renderFixed<16>(xPos, yPos, mosaic, thumbnailTester); return;
+            case 24: renderFixed<24>(xPos, yPos, mosaic, thumbnailTester); return;
+            case 30: renderFixed<30>(xPos, yPos, mosaic, thumbnailTester); return;
+            case 32: renderFixed<32>(xPos, yPos, mosaic, thumbnailTester); return;
+            case 48: renderFixed<48>(xPos, yPos, mosaic, thumbnailTester); return;
+            case 64: renderFixed<64>(xPos, yPos, mosaic, thumbnailTester); return;
+            case 75: renderFixed<75>(xPos, yPos, mosaic, thumbnailTester); return;
+            default: break;
+        }
+    }
+
+    //generic kernel: any size, clipped by getPixel at the mosaic border
+    for (unsigned j = 0; j < thumbnailTester.height(); j++) {
+        for (unsigned i = 0; i < thumbnailTester.width(); i++) {
 
             RGBAPixel * thumbnailTemp = thumbnailTester.getPixel(i, j);
             RGBAPixel * mosaicTemp = mosaic.getPixel(xPos+i, yPos+j);
@@ -77,7 +229,7 @@ void tiler::render(int xPos, int yPos, PNG & mosaic, PNG & thumbnailTester)
 
 /* buildMap: function for building the map of <key, value> pairs, where the key is an
  * RGBAPixel representing the average color over an image, and the value is 
- * a string representing the path/filename.png of the TILESIZExTILESIZE image
+ * a string representing the path/filename.png of the tileSize x tileSize image
  * whose average color is the key.
  * 
  * We've provided a bit of the C++ code that allows you to iterate over the files
@@ -85,9 +237,11 @@ void tiler::render(int xPos, int yPos, PNG & mosaic, PNG & thumbnailTester)
  * 
  * @param path is the subdirectory in which the tiles can be found. In our examples
  * this is imlib.
+ * @param tileSize is the required edge length of every thumbnail; files of any
+ * other size are skipped with a warning.
  *
 */
-map<RGBAPixel, string> tiler::buildMap(string path) 
+map<RGBAPixel, string> tiler::buildMap(string path, unsigned tileSize) 
 {
 
     map <RGBAPixel, string> thumbs;
@@ -95,50 +249,400 @@ map<RGBAPixel, string> tiler::buildMap(string path)
     for (const auto & entry : fs::directory_iterator(path)) 
     
     {
-    PNG curr; curr.readFromFile(entry.path());
+    // decode straight to the RGBA byte buffer and reduce it row by row; no
+    // intermediate PNG / RGBAPixel array is built, so each pixel is touched once
+    colorStats stats;
+    if (!readColorStats(entry.path().string(), stats)) {
+        cerr << "WARNING: buildMap skipping " << entry.path() << ": not a readable PNG" << endl;
+        continue;
+    }
 
-    // find average color by adding up RGB values of all the pixels, then dividing by # pixels
-    // using PNG curr, iterate through every single pixel, adding up the r, g, b channels succesivvely, then divide the sums by # of pixels
-    // afterwards, construct an RGBAPixel with those averaged values
-    // map the newly constructed average RGBAPixel with its corresponding picture, the value being the filePath
+    // validate the thumbnail against the configured tile size before it can be
+    // used as a tile; render would otherwise paint a wrong-sized patch
+    if (stats.width != tileSize || stats.height != tileSize) {
+        cerr << "WARNING: buildMap skipping " << entry.path() << ": " << stats.width
+             << "x" << stats.height << ", expected " << tileSize << "x" << tileSize << endl;
+        continue;
+    }
 
     // one image corresponds to one <K,V> pair in the result map, namely <RGBAPixel,String>
 
-        int currHeight = curr.height();
-        int currWidth  = curr.width(); 
-        int currArea   = currHeight * currWidth; //# pixels in an image 
+        //the average R, G, B values of the image (channel sums / # pixels, truncated)
+        RGBAPixel averagePixel = stats.average();
 
-        int sumR = 0;
-        int sumG = 0;
-        int sumB = 0; 
-
-        for (unsigned x = 0; x < curr.width(); x++) {
-            for (unsigned y = 0; y < curr.height(); y++) {
-                
-                RGBAPixel *pixel = curr.getPixel(x, y);
-                sumR = sumR + pixel->r;
-                sumG = sumG + pixel->g;
-                sumB = sumB + pixel->b;
+        //update our map with key (averagePixel) and corresponding value (file path)
+        thumbs[averagePixel] = entry.path();
         
+    }
+    return thumbs;
+}
+
+/**
+ * Area-filter weights along one axis, from n source pixels to t output pixels.
+ * Working in coordinates scaled by t (source pixel i covers [i*t, (i+1)*t)) and
+ * n (output pixel o covers [o*n, (o+1)*n)), every overlap is an integer, and the
+ * weights of each output sum to exactly n.
+ */
+static void buildAxisWeights(unsigned n, unsigned t, vector<unsigned> & first,
+                             vector<unsigned> & count, vector<unsigned> & weights)
+{
+    first.resize(t);
+    count.resize(t);
+    weights.clear();
+
+    for (unsigned o = 0; o < t; o++) {
+        uint64_t lo = (uint64_t) o * n;
+        uint64_t hi = (uint64_t) (o + 1) * n;
+        unsigned i0 = lo / t;
+        unsigned i1 = (hi - 1) / t;
+        first[o] = i0;
+        count[o] = i1 - i0 + 1;
+        for (unsigned i = i0; i <= i1; i++) {
+            uint64_t a = max<uint64_t>(lo, (uint64_t) i * t);
+            uint64_t b = min<uint64_t>(hi, (uint64_t) (i + 1) * t);
+            weights.push_back(b - a);
+        }
+    }
+}
+
+void tiler::resampleTile(const unsigned char * rgba, unsigned width, unsigned height,
+                         unsigned tileSize, vector<unsigned char> & out, RGBAPixel & average)
+{
+    // largest centered square
+    unsigned side = min(width, height);
+    unsigned x0 = (width - side) / 2;
+    unsigned y0 = (height - side) / 2;
+
+    vector<unsigned> first, count, weights;
+    buildAxisWeights(side, tileSize, first, count, weights);
+
+    // horizontal pass: one source row -> tileSize RGBA sums (each <= side * 255).
+    // the four channels are summed together so the inner loop is a 4-lane
+    // multiply-add the compiler turns into a single vector op.
+    auto horizontal = [&](unsigned row, uint32_t * h) {
+        const unsigned char * src = rgba + ((size_t) (y0 + row) * width + x0) * 4;
+        unsigned w = 0;
+        for (unsigned o = 0; o < tileSize; o++) {
+            uint32_t acc[4] = {0, 0, 0, 0};
+            const unsigned char * px = src + (size_t) first[o] * 4;
+            for (unsigned k = 0; k < count[o]; k++, w++, px += 4) {
+                for (int c = 0; c < 4; c++) { acc[c] += weights[w] * px[c]; }
+            }
+            for (int c = 0; c < 4; c++) { h[o * 4 + c] = acc[c]; }
+        }
+    };
+
+    // vertical pass: stream the source rows each output row covers. adjacent
+    // output rows share at most their boundary source row, so one cached row
+    // avoids filtering it twice.
+    unsigned lanes = tileSize * 4;
+    vector<uint32_t> hrow(lanes), cached(lanes);
+    unsigned cachedRow = UINT_MAX;
+    vector<uint64_t> acc(lanes);
+    uint64_t norm = (uint64_t) side * side;
+
+    out.resize((size_t) lanes * tileSize);
+
+    unsigned w = 0;
+    for (unsigned oy = 0; oy < tileSize; oy++) {
+        fill(acc.begin(), acc.end(), 0);
+        for (unsigned k = 0; k < count[oy]; k++, w++) {
+            unsigned row = first[oy] + k;
+            const uint32_t * h;
+            if (row == cachedRow) {
+                h = cached.data();
+            } else {
+                horizontal(row, hrow.data());
+                h = hrow.data();
+            }
+            uint64_t wy = weights[w];
+            for (unsigned i = 0; i < lanes; i++) { acc[i] += wy * h[i]; }
+            if (k + 1 == count[oy] && h == hrow.data()) {
+                swap(hrow, cached);
+                cachedRow = row;
             }
         }
-    
-        //calculate the average R, G, B values 
-        int averageR = sumR/currArea;
-        int averageG = sumG/currArea;
-        int averageB = sumB/currArea;
-        
-        //construct the new RGBAPixel object representing the average color of the image
-        RGBAPixel averagePixel = RGBAPixel(averageR, averageG, averageB, 255);
-        //RGBAPixel * averagePixel = new RGBAPixel(averageR, averageG, averageB, 255);
 
-        //update our map with key (averagePixel) and corresponding value (file path)
-        thumbs[averagePixel] = entry.path();
-        
+        unsigned char * dst = &out[(size_t) oy * lanes];
+        for (unsigned i = 0; i < lanes; i++) {
+            dst[i] = (acc[i] + norm / 2) / norm;
+        }
+    }
+
+    // the average of the rounded tile as written, exactly as buildMap reads
+    // it back, rather than of the unrounded sums
+    colorStats stats;
+    accumulateColorStats(out.data(), tileSize, tileSize, stats);
+    average = stats.average();
+}
+
+map<RGBAPixel, string> tiler::ingestLibrary(string srcPath, string dstPath,
+                                            unsigned tileSize, unsigned threads)
+{
+    vector<fs::path> files;
+    for (const auto & entry : fs::directory_iterator(srcPath)) {
+        if (entry.is_regular_file()) { files.push_back(entry.path()); }
+    }
+    // directory order is unspecified; sort so repeated ingests agree on which
+    // file wins when two originals average to the same color
+    sort(files.begin(), files.end());
+
+    // each original is written as <name>.png, so a.png, a.PNG and a would all
+    // land on one file: the first in sorted order keeps the name
+    vector<string> targets(files.size());
+    map<string, size_t> claimed;
+    for (size_t i = 0; i < files.size(); i++) {
+        string target = (fs::path(dstPath) / files[i].filename()).replace_extension(".png").string();
+        auto claim = claimed.insert(make_pair(target, i));
+        if (!claim.second) {
+            cerr << "WARNING: ingestLibrary skipping " << files[i] << ": " << files[claim.first->second]
+                 << " is also written to " << target << endl;
+            continue;
+        }
+        targets[i] = target;
+    }
+
+    // thumbnails from an earlier ingest would otherwise be picked up by
+    // buildMap and buildBlockLibrary alongside this one's
+    fs::create_directories(dstPath);
+    for (const auto & entry : fs::directory_iterator(dstPath)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".png") { fs::remove(entry.path()); }
+    }
+
+    vector<RGBAPixel> averages(files.size());
+    vector<string> outPaths(files.size());
+    mutex logLock;
+
+    parallel::parallelFor(files.size(), threads, [&](size_t i) {
+        if (targets[i].empty()) { return; }
+        vector<unsigned char> bytes;
+        unsigned width, height;
+        unsigned error = lodepng::decode(bytes, width, height, files[i].string());
+        if (error) {
+            lock_guard<mutex> guard(logLock);
+            cerr << "WARNING: ingestLibrary skipping " << files[i] << ": "
+                 << lodepng_error_text(error) << endl;
+            return;
+        }
+
+        vector<unsigned char> thumb;
+        resampleTile(bytes.data(), width, height, tileSize, thumb, averages[i]);
+
+        const string & outPath = targets[i];
+        error = lodepng::encode(outPath, thumb, tileSize, tileSize);
+        if (error) {
+            lock_guard<mutex> guard(logLock);
+            cerr << "WARNING: ingestLibrary could not write " << outPath << ": "
+                 << lodepng_error_text(error) << endl;
+            return;
+        }
+        outPaths[i] = outPath;
+    });
+
+    map<RGBAPixel, string> thumbs;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!outPaths[i].empty()) { thumbs[averages[i]] = outPaths[i]; }
     }
     return thumbs;
 }
 
+RGBAPixel tiler::colorStats::average() const
+{
+    uint64_t area = (uint64_t) width * height;
+    if (area == 0) { return RGBAPixel(); }
+    return RGBAPixel(sum[0] / area, sum[1] / area, sum[2] / area, 255);
+}
+
+RGBAPixel tiler::colorStats::blockAverage(unsigned cx, unsigned cy) const
+{
+    uint64_t bw = (uint64_t) (cx + 1) * width / grid - (uint64_t) cx * width / grid;
+    uint64_t bh = (uint64_t) (cy + 1) * height / grid - (uint64_t) cy * height / grid;
+    if (bw * bh == 0) { return average(); }
+    const uint64_t * cell = &blockSum[(cy * grid + cx) * 3];
+    return RGBAPixel(cell[0] / (bw * bh), cell[1] / (bw * bh), cell[2] / (bw * bh), 255);
+}
+
+double tiler::colorStats::variance(int channel) const
+{
+    double area = (double) width * height;
+    if (area == 0) { return 0; }
+    double mean = sum[channel] / area;
+    return sumSq[channel] / area - mean * mean;
+}
+
+void tiler::accumulateColorStats(const unsigned char * rgba, unsigned width, unsigned height,
+                                 colorStats & stats, unsigned grid, bool withVariance)
+{
+    if (grid == 0) { grid = 1; }
+    stats.width = width;
+    stats.height = height;
+    stats.grid = grid;
+    stats.blockSum.assign((size_t) grid * grid * 3, 0);
+    for (int c = 0; c < 3; c++) { stats.sum[c] = 0; stats.sumSq[c] = 0; }
+
+    // column boundaries of the sub-blocks; a grid of 1 is the whole row
+    vector<unsigned> xb(grid + 1);
+    for (unsigned i = 0; i <= grid; i++) { xb[i] = (uint64_t) i * width / grid; }
+
+    // per-segment sums are kept in 32-bit lanes and flushed into the 64-bit
+    // totals. a lane holds CHUNK pixels of 255 (or 255^2 for the squares)
+    // without overflowing, so long rows are cut into chunks of that length.
+    const unsigned CHUNK = 65535;
+
+    for (unsigned y = 0; y < height; y++) {
+        const unsigned char * row = rgba + (size_t) y * width * 4;
+        uint64_t * cells = &stats.blockSum[(size_t) ((uint64_t) y * grid / height) * grid * 3];
+
+        for (unsigned cx = 0; cx < grid; cx++) {
+            for (unsigned x0 = xb[cx]; x0 < xb[cx + 1]; x0 += CHUNK) {
+                unsigned x1 = min(xb[cx + 1], x0 + CHUNK);
+                uint32_t acc[4] = {0, 0, 0, 0};
+                const unsigned char * px = row + (size_t) x0 * 4;
+                for (unsigned x = x0; x < x1; x++, px += 4) {
+                    for (int c = 0; c < 4; c++) { acc[c] += px[c]; }
+                }
+                for (int c = 0; c < 3; c++) { cells[cx * 3 + c] += acc[c]; }
+
+                if (withVariance) {
+                    uint32_t sq[4] = {0, 0, 0, 0};
+                    px = row + (size_t) x0 * 4;
+                    for (unsigned x = x0; x < x1; x++, px += 4) {
+                        for (int c = 0; c < 4; c++) { sq[c] += px[c] * px[c]; }
+                    }
+                    for (int c = 0; c < 3; c++) { stats.sumSq[c] += sq[c]; }
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < stats.blockSum.size(); i++) { stats.sum[i % 3] += stats.blockSum[i]; }
+}
+
+bool tiler::readColorStats(const string & fileName, colorStats & stats,
+                           unsigned grid, bool withVariance)
+{
+    vector<unsigned char> bytes;
+    unsigned width, height;
+    unsigned error = lodepng::decode(bytes, width, height, fileName);
+    if (error) { return false; }
+
+    accumulateColorStats(bytes.data(), width, height, stats, grid, withVariance);
+    return true;
+}
+
+bool tiler::readIndexedPNG(const string & fileName, indexedImage & image)
+{
+    vector<unsigned char> file, raw;
+    if (lodepng::load_file(file, fileName) != 0) { return false; }
+
+    //the header alone says whether this is a palette image
+    lodepng::State state;
+    unsigned width, height;
+    if (lodepng_inspect(&width, &height, &state, file.data(), file.size()) != 0 ||
+        state.info_png.color.colortype != LCT_PALETTE) { return false; }
+
+    //without color conversion the indices come back at the file's bit depth,
+    //packed MSB first with no padding between rows
+    state.decoder.color_convert = 0;
+    if (lodepng::decode(raw, width, height, state, file) != 0) { return false; }
+
+    const LodePNGColorMode & color = state.info_png.color;
+    unsigned depth = color.bitdepth;
+    image.width = width;
+    image.height = height;
+    image.palette.resize(color.palettesize);
+    for (size_t i = 0; i < color.palettesize; i++) {
+        image.palette[i] = RGBAPixel(color.palette[4*i], color.palette[4*i + 1],
+                                     color.palette[4*i + 2], color.palette[4*i + 3]);
+    }
+
+    size_t n = (size_t) width * height;
+    image.indices.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        size_t bit = i * depth;
+        unsigned index = (raw[bit / 8] >> (8 - depth - bit % 8)) & ((1u << depth) - 1);
+        if (index >= color.palettesize) { return false; }
+        image.indices[i] = (unsigned char) index;
+    }
+    return true;
+}
+
+tiler::blockLibrary tiler::buildBlockLibrary(string path, unsigned grid, unsigned tileSize)
+{
+    blockLibrary library;
+    library.grid = grid;
+
+    for (const auto & entry : fs::directory_iterator(path)) {
+        colorStats stats;
+        if (!readColorStats(entry.path().string(), stats, grid)) {
+            cerr << "WARNING: buildBlockLibrary skipping " << entry.path() << ": not a readable PNG" << endl;
+            continue;
+        }
+        if (stats.width != tileSize || stats.height != tileSize) {
+            cerr << "WARNING: buildBlockLibrary skipping " << entry.path() << ": " << stats.width
+                 << "x" << stats.height << ", expected " << tileSize << "x" << tileSize << endl;
+            continue;
+        }
+
+        for (unsigned cy = 0; cy < grid; cy++) {
+            for (unsigned cx = 0; cx < grid; cx++) {
+                RGBAPixel mean = stats.blockAverage(cx, cy);
+                library.descriptors.push_back(mean.r);
+                library.descriptors.push_back(mean.g);
+                library.descriptors.push_back(mean.b);
+            }
+        }
+        library.files.push_back(entry.path().string());
+    }
+    return library;
+}
+
+void tiler::regionDescriptor(PNG & image, unsigned x0, unsigned y0, unsigned w, unsigned h,
+                             unsigned grid, unsigned char * out)
+{
+    for (unsigned cy = 0; cy < grid; cy++) {
+        unsigned ya = cy * h / grid, yb = (cy + 1) * h / grid;
+        for (unsigned cx = 0; cx < grid; cx++) {
+            unsigned xa = cx * w / grid, xb = (cx + 1) * w / grid;
+            unsigned sum[3] = {0, 0, 0};
+            for (unsigned y = ya; y < yb; y++) {
+                const RGBAPixel * row = image.getPixel(x0, y0 + y);
+                for (unsigned x = xa; x < xb; x++) {
+                    sum[0] += row[x].r;
+                    sum[1] += row[x].g;
+                    sum[2] += row[x].b;
+                }
+            }
+            unsigned area = max(1u, (xb - xa) * (yb - ya));
+            for (int c = 0; c < 3; c++) { *out++ = sum[c] / area; }
+        }
+    }
+}
+
+PNG tiler::tileBlocks(PNG & target, const blocktree & ss, const blockLibrary & library,
+                      unsigned cell, unsigned tileSize)
+{
+    unsigned grid = library.grid;
+    if (cell < grid) { cell = grid; }
+
+    unsigned across = target.width() / cell;
+    unsigned down = target.height() / cell;
+    PNG mosaic(across * tileSize, down * tileSize);
+
+    vector<unsigned char> query(3 * grid * grid);
+    for (unsigned ty = 0; ty < down; ty++) {
+        for (unsigned tx = 0; tx < across; tx++) {
+            regionDescriptor(target, tx * cell, ty * cell, cell, cell, grid, query.data());
+            int match = ss.findNearestNeighbor(query.data());
+            if (match < 0) { continue; }
+
+            PNG thumbnail; thumbnail.readFromFile(library.files[match]);
+            render(tileSize * tx, tileSize * ty, mosaic, thumbnail);
+        }
+    }
+    return mosaic;
+}
+
 
 // // File:        tileUtil.cpp
 // // Author:      Cinda
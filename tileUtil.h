@@ -2,35 +2,118 @@
 #define _TILER_
 
 #include "rgbtree.h"
+#include "blocktree.h"
+#include "nnindex.h"
 #include "cs221util/PNG.h"
 #include "cs221util/RGBAPixel.h"
+#include <cstdint>
 #include <filesystem>
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
 namespace fs = std::filesystem;
 
 
+// default edge length, in pixels, of a square thumbnail tile. libraries built
+// at other sizes pass their tile size explicitly to buildMap and tile.
 #define TILESIZE 30
 
 namespace tiler {
 
+/* tileStats: what one call to tile did, for the run report. */
+struct tileStats {
+    size_t pixels;          // target pixels
+    size_t distinct;        // distinct target colors, each searched once
+    double searchSeconds;   // wall time resolving the distinct colors
+
+    // pixels per search: how much the deduplication saved
+    double dedupRatio() const { return distinct ? (double) pixels / distinct : 0; }
+};
+
 /**
  * Function tile:
  * @param PNG & target: an image to use as base for the mosaic. it's pixels will be
  *                      be replaced by thumbnail images whose average color is close
  *                      to the pixel.
- * @param rgbtree & ss: a kd-tree of RGBAPixels, used as a query structure for
- *                      nearest neighbor search. 
+ * @param nnindex & ss: the matching engine built from photos -- an rgbtree (sRGB
+ *                      kd-tree), a labindex (CIELAB), ... -- used as a query
+ *                      structure for nearest neighbor search.
  * @param map<RGBAPixel, string> & photos: a map that takes a color key and returns the
  *                      filename of an image whose average color is that key.
+ * @param unsigned tileSize: edge length of the (square) thumbnails in photos. Must
+ *                      match the size the library was validated against in buildMap.
+ * @param tileStats * stats: if not NULL, receives the pixel and distinct color
+ *                      counts and the search time.
  *
- * returns: a PNG whose dimensions are TILESIZE times that of the target. Each
- * pixel in the target is used as a query to ss.findNearestNeighbor, and the response
- * is used as a key in photos. 
+ * returns: a PNG whose dimensions are tileSize times that of the target. Each
+ * distinct color of the target is searched once -- targets usually have far
+ * fewer colors than pixels -- with the batches spread over threads, and each
+ * response is used as a key in photos.
+ */
+
+PNG tile(PNG & target, const nnindex & ss, map<RGBAPixel,string> & photos,
+         unsigned tileSize = TILESIZE, tileStats * stats = NULL);
+
+/* indexedImage: a palette-based target as stored in the file: one palette index
+ * per pixel, row-major, plus the palette (alpha from tRNS). A quarter of the
+ * memory of the expanded RGBA image. */
+struct indexedImage {
+    unsigned width;
+    unsigned height;
+    vector<RGBAPixel> palette;
+    vector<unsigned char> indices;
+};
+
+/* readIndexedPNG: decodes a palette-based PNG without expanding it. Returns false,
+ * without a message, for any file that isn't a readable palette PNG, so the caller
+ * can fall back to PNG::readFromFile (which reports real decode errors). */
+bool readIndexedPNG(const string & fileName, indexedImage & image);
+
+/* tileIndexed: tile for an indexedImage. Only the palette entries (at most 256) are
+ * searched, each thumbnail is read once per palette entry, and the mosaic is
+ * rendered straight from the index plane. The result is identical to tile on the
+ * expanded image; stats counts palette entries as the distinct colors. */
+PNG tileIndexed(const indexedImage & target, const nnindex & ss, map<RGBAPixel,string> & photos,
+                unsigned tileSize = TILESIZE, tileStats * stats = NULL);
+
+/* colorStats: per-image channel statistics gathered in a single pass over the
+ * decoded scanlines. sums are 64-bit so arbitrarily large images can't overflow.
+ * The image is also cut into a grid x grid array of sub-blocks (block (cx, cy)
+ * covers columns [cx*width/grid, (cx+1)*width/grid) and likewise for rows) whose
+ * channel sums are kept in blockSum, row-major, 3 entries per block.
  */
+struct colorStats {
+    unsigned width;
+    unsigned height;
+    unsigned grid;
+    uint64_t sum[3];            // r, g, b totals over the whole image
+    uint64_t sumSq[3];          // r, g, b sums of squares, only if requested
+    vector<uint64_t> blockSum;  // grid * grid * 3 sub-block totals
 
-PNG tile(PNG & target, const rgbtree & ss, map<RGBAPixel,string> & photos);
+    /* mean color, truncated per channel, opaque. */
+    RGBAPixel average() const;
+    /* mean color of sub-block (cx, cy), truncated per channel, opaque. */
+    RGBAPixel blockAverage(unsigned cx, unsigned cy) const;
+    /* population variance of channel 0 (r), 1 (g) or 2 (b). */
+    double variance(int channel) const;
+};
+
+/* accumulateColorStats: reduces a decoded RGBA8 buffer into stats. Channels are
+ * summed four lanes at a time into 32-bit accumulators per row segment, which
+ * are then widened into the 64-bit totals.
+ *
+ * @param grid sub-block grid edge (1 = whole image only).
+ * @param withVariance also accumulate sums of squares.
+ */
+void accumulateColorStats(const unsigned char * rgba, unsigned width, unsigned height,
+                          colorStats & stats, unsigned grid = 1, bool withVariance = false);
+
+/* readColorStats: decodes a PNG and reduces it with accumulateColorStats without
+ * building a PNG object. returns false if the file couldn't be decoded.
+ */
+bool readColorStats(const string & fileName, colorStats & stats,
+                    unsigned grid = 1, bool withVariance = false);
 
 /* buildMap: function for building the map of <key, value> pairs, where the key is an
  * RGBAPixel representing the average color over an image, and the value is 
@@ -42,11 +125,97 @@ PNG tile(PNG & target, const rgbtree & ss, map<RGBAPixel,string> & photos);
  * 
  * @param path is the subdirectory in which the tiles can be found. In our examples
  * this is imlib.
+ * @param tileSize is the required edge length of every thumbnail. Files that fail
+ * to decode, or whose dimensions are not tileSize x tileSize, are reported on cerr
+ * and left out of the map, so a mixed library can't silently corrupt the mosaic.
  *
 */
-map<RGBAPixel, string> buildMap(string path);
+map<RGBAPixel, string> buildMap(string path, unsigned tileSize = TILESIZE);
+
+/* ingestLibrary: builds a tile store from a directory of full-size originals, so
+ * a library can be rebuilt without an external preprocessing step. Every
+ * decodable PNG under srcPath is center-cropped to a square, area-resampled to
+ * tileSize x tileSize with resampleTile, and written to dstPath under its
+ * original file name with a .png extension. Originals whose names would land
+ * on the same output file (a, a.png, a.PNG) are reported on cerr, and only
+ * the first in sorted order is ingested. Files are processed on `threads`
+ * workers (0 = one per core); undecodable files are reported on cerr and
+ * skipped.
+ *
+ * @param srcPath directory holding the originals.
+ * @param dstPath directory the thumbnails are written to; created if missing.
+ *        Any .png files already in it are deleted first, so the store holds
+ *        exactly this ingest's thumbnails.
+ * @param tileSize edge length of the generated thumbnails.
+ * @param threads number of worker threads, 0 for the hardware default.
+ *
+ * returns: the <average color, thumbnail path> map buildMap produces for
+ * dstPath afterwards, computed during resampling rather than by re-reading
+ * the files. Where two thumbnails share an average, the later one in sorted
+ * order is kept; buildMap keeps whichever its directory listing gives last.
+ */
+map<RGBAPixel, string> ingestLibrary(string srcPath, string dstPath,
+                                     unsigned tileSize = TILESIZE, unsigned threads = 0);
+
+/* resampleTile: separable box (area) filter from an arbitrary RGBA8 image to a
+ * tileSize x tileSize RGBA8 tile. The largest centered square of the source is
+ * used so tiles keep their aspect ratio. Each output pixel is the exact area
+ * weighted mean of the source pixels it covers (weights are integer overlap
+ * lengths, so nothing drifts), and works for up- as well as downsampling.
+ *
+ * @param rgba source pixels, row-major, 4 bytes per pixel.
+ * @param width source width.
+ * @param height source height.
+ * @param tileSize output edge length.
+ * @param out receives tileSize * tileSize * 4 bytes.
+ * @param average receives the mean color of the tile in out, as buildMap
+ *        computes it from the written file (colorStats::average, truncated).
+ */
+void resampleTile(const unsigned char * rgba, unsigned width, unsigned height,
+                  unsigned tileSize, vector<unsigned char> & out, RGBAPixel & average);
+
+/* blockLibrary: sub-block descriptors of a thumbnail library, laid out the way
+ * blocktree expects (3 * grid * grid bytes per file, r, g, b per block,
+ * blocks row-major), plus the file each descriptor came from.
+ */
+struct blockLibrary {
+    unsigned grid;
+    vector<unsigned char> descriptors;
+    vector<string> files;
+};
+
+/* buildBlockLibrary: like buildMap, but describes each thumbnail by the mean
+ * colors of a grid x grid array of sub-blocks (grid 2 -> 12-D, grid 3 -> 27-D)
+ * instead of a single average. Files that aren't tileSize x tileSize PNGs are
+ * skipped with a warning.
+ */
+blockLibrary buildBlockLibrary(string path, unsigned grid, unsigned tileSize = TILESIZE);
+
+/* tileBlocks: structure-aware counterpart of tile. Each cell x cell region of the
+ * target becomes one thumbnail: the region is downsampled to grid x grid means,
+ * matched against the library descriptors in ss, and replaced by the winning
+ * file. cell must be at least grid; the result is tileSize * (width / cell) by
+ * tileSize * (height / cell), any partial cells at the edges being dropped.
+ */
+PNG tileBlocks(PNG & target, const blocktree & ss, const blockLibrary & library,
+               unsigned cell, unsigned tileSize = TILESIZE);
+
+/* regionDescriptor: the grid x grid mean colors of the w x h region of image
+ * with upper left corner (x0, y0), in blockLibrary layout. Sub-block boundaries
+ * follow the same i * w / grid rule as colorStats, so target regions and
+ * thumbnails are cut identically.
+ */
+void regionDescriptor(PNG & image, unsigned x0, unsigned y0, unsigned w, unsigned h,
+                      unsigned grid, unsigned char * out);
 
 //PNG renderThumbNailOntoMosaic(PNG & thumbnail, PNG & mosaic, int positionX, int positionY);
+
+/* render: copies the rgb channels of a thumbnail into the mosaic with its upper
+ * left corner at (xPos, yPos). Square thumbnails of the common tile sizes
+ * (16, 24, 30, 32, 48, 64, 75) that fit inside the mosaic are copied by a kernel
+ * specialized on the size, so the row loop is fully unrolled; anything else goes
+ * through the generic per-pixel copy.
+ */
 void render(int xPos, int yPos, PNG & mosaic, PNG & thumbnailTester);
 }
 
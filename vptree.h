@@ -0,0 +1,247 @@
+/**
+ *
+ * vptree: vantage-point tree for metrics that aren't coordinate-wise
+ *
+ */
+
+#ifndef _VPTREE_H_
+#define _VPTREE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "parallel.h"
+using namespace std;
+
+/**
+ * euclidean: plain (not squared) Euclidean distance over K coordinates. A
+ * vptree metric provides
+ *   distance(a, b): the distance between two points,
+ * and nothing else; pruning relies only on the triangle inequality, so any
+ * true metric works, however it is computed.
+ */
+template <class T, int K>
+struct euclidean {
+    typedef T value_type;
+
+    template <class Point>
+    static T distance(const Point & a, const Point & b)
+    {
+        T sum = 0;
+        for (int d = 0; d < K; d++) {
+            T diff = (T) a[d] - (T) b[d];
+            sum += diff * diff;
+        }
+        return sqrt(sum);
+    }
+};
+
+/**
+ * vptree<Point, Metric>: nearest neighbor search under any metric. kdtree's
+ * splitting planes only prune for distances that are sums of per-coordinate
+ * terms; here each node instead splits its points by their distance to a
+ * vantage point, at the median, and a query skips the inside (the ball) or
+ * the outside when the triangle inequality says nothing there can beat the
+ * best distance so far. So expensive perceptual metrics are evaluated on a
+ * small part of the library instead of all of it.
+ *
+ * Layout: implicit, like kdtree's. The node for the range [start, end] is its
+ * vantage point at start, with threshold[start] the median distance; the ball
+ * is [start+1, middle] and the outside [middle+1, end]. Ranges of LEAF points
+ * or fewer are scanned.
+ *
+ * Point needs an int `id` payload, which settles ties: among equally distant
+ * points the one with the smaller id wins, whatever order they were reached
+ * in. The build is deterministic and its top levels use all threads.
+ */
+template <class Point, class Metric>
+class vptree {
+
+public:
+
+    typedef typename Metric::value_type distance_type;
+
+    /** Ranges this small are scanned rather than split. */
+    static const int LEAF = 8;
+
+    vptree() {}
+
+    /**
+     * Builds the tree over a copy of points.
+     *
+     * @param threads workers for the build; 0 means all.
+     */
+    vptree(const vector<Point> & points, unsigned threads = 0)
+      : tree(points), threshold(points.size(), 0)
+    {
+        if (threads == 0) { threads = parallel::defaultThreads(); }
+        scratch.resize(tree.size());
+        buildTreeParallel(threads);
+        vector<pair<distance_type, Point> >().swap(scratch);
+    }
+
+    /**
+     * Finds the point closest to query under Metric.
+     *
+     * @param query the point to search for.
+     * @param evaluations if not NULL, incremented by the number of distances
+     *  computed.
+     * @return the position in points() of the nearest point, or -1 if the
+     *  tree is empty.
+     */
+    int findNearestIndex(const Point & query, long * evaluations = NULL) const
+    {
+        int best = -1;
+        distance_type bestDistance = numeric_limits<distance_type>::max();
+        long count = 0;
+
+        search(query, 0, size() - 1, best, bestDistance, count);
+
+        if (evaluations != NULL) { *evaluations += count; }
+        return best;
+    }
+
+    /**
+     * Finds the point closest to query. The tree must not be empty.
+     */
+    const Point & findNearestNeighbor(const Point & query, long * evaluations = NULL) const
+    {
+        return tree[findNearestIndex(query, evaluations)];
+    }
+
+    /** The points, in tree order. */
+    const vector<Point> & points() const { return tree; }
+
+    int size() const { return (int) tree.size(); }
+
+private:
+
+    vector<Point> tree;                   // points in implicit tree order
+    vector<distance_type> threshold;      // median distance per node
+    vector<pair<distance_type, Point> > scratch;   // build only
+
+    struct range { int start, end; };
+
+    /* where the ball of the node for [start, end] ends */
+    static int middle(int start, int end) { return start + (end - start + 1) / 2; }
+
+    /**
+     * Makes tree[start] the node's vantage point and splits the rest around
+     * its median distance. The vantage point is the point farthest from the
+     * range's first one: points near the edge of the set split it best. The
+     * distances of a big range are computed by all threads.
+     */
+    void split(int start, int end, unsigned threads)
+    {
+        const int BLOCK = 4096;
+        int n = end - start + 1;
+        int blocks = threads > 1 ? (n + BLOCK - 1) / BLOCK : 1;
+        int blockSize = (n + blocks - 1) / blocks;
+
+        // farthest from tree[start], the first of the farthest in each block
+        vector<pair<distance_type, int> > farthest(blocks, make_pair((distance_type) -1, start));
+        parallel::parallelFor(blocks, threads, [&](size_t b) {
+            int from = start + (int) b * blockSize, to = min(end, from + blockSize - 1);
+            for (int i = from; i <= to; i++) {
+                distance_type d = Metric::distance(tree[start], tree[i]);
+                if (d > farthest[b].first) { farthest[b] = make_pair(d, i); }
+            }
+        });
+        int vantage = start;
+        distance_type far = -1;
+        for (int b = 0; b < blocks; b++) {
+            if (farthest[b].first > far) { far = farthest[b].first; vantage = farthest[b].second; }
+        }
+        swap(tree[start], tree[vantage]);
+
+        parallel::parallelFor(blocks, threads, [&](size_t b) {
+            int from = max(start + 1, start + (int) b * blockSize), to = min(end, start + ((int) b + 1) * blockSize - 1);
+            for (int i = from; i <= to; i++) { scratch[i] = make_pair(Metric::distance(tree[start], tree[i]), tree[i]); }
+        });
+
+        // ties on the distance are broken by the payload so the build is
+        // deterministic for any input order
+        int m = middle(start, end);
+        nth_element(scratch.begin() + start + 1, scratch.begin() + m, scratch.begin() + end + 1,
+                    [](const pair<distance_type, Point> & a, const pair<distance_type, Point> & b) {
+                        return a.first < b.first || (a.first == b.first && a.second.id < b.second.id);
+                    });
+        threshold[start] = scratch[m].first;
+        for (int i = start + 1; i <= end; i++) { tree[i] = scratch[i].second; }
+    }
+
+    void buildTree(int start, int end)
+    {
+        if (end - start + 1 <= LEAF) { return; }
+        split(start, end, 1);
+        buildTree(start + 1, middle(start, end));
+        buildTree(middle(start, end) + 1, end);
+    }
+
+    void buildTreeParallel(unsigned threads)
+    {
+        vector<range> level(1, range{0, size() - 1});
+
+        // split level by level while there are fewer subtrees than workers to
+        // keep busy; every split of a big range is itself done by all threads
+        while (threads > 1 && level.size() < 4 * threads) {
+            vector<range> next;
+            for (const range & r : level) {
+                if (r.end - r.start + 1 <= LEAF) { continue; }
+                split(r.start, r.end, threads);
+                next.push_back(range{r.start + 1, middle(r.start, r.end)});
+                next.push_back(range{middle(r.start, r.end) + 1, r.end});
+            }
+            if (next.empty()) { return; }
+            level.swap(next);
+        }
+
+        // the rest are disjoint ranges of the array: build them as separate tasks
+        parallel::parallelFor(level.size(), threads, [&](size_t i) {
+            buildTree(level[i].start, level[i].end);
+        });
+    }
+
+    void offer(int i, distance_type d, int & best, distance_type & bestDistance) const
+    {
+        if (d < bestDistance || (d == bestDistance && tree[i].id < tree[best].id)) {
+            best = i;
+            bestDistance = d;
+        }
+    }
+
+    void search(const Point & query, int start, int end, int & best,
+                distance_type & bestDistance, long & evaluations) const
+    {
+        if (start > end) { return; }
+
+        if (end - start + 1 <= LEAF) {
+            for (int i = start; i <= end; i++) {
+                offer(i, Metric::distance(query, tree[i]), best, bestDistance);
+            }
+            evaluations += end - start + 1;
+            return;
+        }
+
+        distance_type d = Metric::distance(query, tree[start]);
+        evaluations++;
+        offer(start, d, best, bestDistance);
+
+        // the side the query is on first; the other only if the best ball
+        // reaches across the threshold (touching it counts, for the ties)
+        distance_type mu = threshold[start];
+        int m = middle(start, end);
+        if (d <= mu) {
+            search(query, start + 1, m, best, bestDistance, evaluations);
+            if (d + bestDistance >= mu) { search(query, m + 1, end, best, bestDistance, evaluations); }
+        }
+        else {
+            search(query, m + 1, end, best, bestDistance, evaluations);
+            if (d - bestDistance <= mu) { search(query, start + 1, m, best, bestDistance, evaluations); }
+        }
+    }
+};
+
+#endif